@@ -0,0 +1,70 @@
+#include "arena.h"
+#include <cstring>
+
+namespace {
+
+// Overflow chunks keep their header in the first ALIGNMENT bytes
+const size_t CHUNK_HEADER = Arena::ALIGNMENT;
+
+} // namespace
+
+Arena& Arena::current() {
+    thread_local Arena arena;
+    return arena;
+}
+
+Arena::Arena() : blockSize(INITIAL_SIZE), used(0), overflow(nullptr), overflowBytes(0), depth(0) {
+    block = new char[blockSize];
+}
+
+Arena::~Arena() {
+    while (overflow) {
+        Chunk* next = overflow->next;
+        delete[] (char*)overflow;
+        overflow = next;
+    }
+    delete[] block;
+}
+
+void* Arena::allocate(size_t bytes) {
+    bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (bytes <= blockSize - used) {
+        void* result = block + used;
+        used += bytes;
+        return result;
+    }
+
+    // new[] of char is aligned for any fundamental type, at least 16 bytes
+    char* chunk = new char[CHUNK_HEADER + bytes];
+    ((Chunk*)chunk)->next = overflow;
+    overflow = (Chunk*)chunk;
+    overflowBytes += bytes;
+    return chunk + CHUNK_HEADER;
+}
+
+char* Arena::copyString(const char* str) {
+    size_t length = strlen(str);
+    char* copy = (char*)allocate(length + 1);
+    memcpy(copy, str, length + 1);
+    return copy;
+}
+
+void Arena::release(size_t mark) {
+    used = mark;
+    if (--depth > 0 || !overflow) return;
+
+    // Nothing is live any more: fold the overflow into one larger block
+    size_t needed = blockSize + overflowBytes;
+    while (overflow) {
+        Chunk* next = overflow->next;
+        delete[] (char*)overflow;
+        overflow = next;
+    }
+    overflowBytes = 0;
+
+    size_t grown = blockSize;
+    while (grown < needed) grown *= 2;
+    delete[] block;
+    block = new char[grown];
+    blockSize = grown;
+}
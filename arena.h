@@ -0,0 +1,67 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+
+// Bump allocator for the temporaries of one command: parsed arguments,
+// list copies, candidate arrays and reply text. Each thread owns one
+// arena. An ArenaScope marks the current position and rolls back to it
+// on exit, so everything allocated inside is released at once. Allocate
+// only while a scope is open.
+//
+// Requests that do not fit the block get their own heap chunk. When the
+// outermost scope closes, those chunks are freed and the block grows to
+// cover them, so a steady workload stops touching the heap entirely.
+class Arena {
+public:
+    static const size_t INITIAL_SIZE = 64 * 1024;
+    static const size_t ALIGNMENT = 16;
+
+    // This thread's arena
+    static Arena& current();
+
+    // Uninitialized, ALIGNMENT-aligned memory valid until the enclosing
+    // scope closes. Never returns nullptr.
+    void* allocate(size_t bytes);
+    template <typename T>
+    T* allocateArray(int count) { return (T*)allocate(sizeof(T) * (count > 0 ? count : 1)); }
+    char* copyString(const char* str);
+
+    size_t capacity() const { return blockSize; }
+
+private:
+    friend class ArenaScope;
+
+    struct Chunk {
+        Chunk* next;
+    };
+
+    char* block;
+    size_t blockSize;
+    size_t used;
+    Chunk* overflow;       // chunks for requests the block could not fit
+    size_t overflowBytes;
+    int depth;             // open scopes
+
+    Arena();
+    ~Arena();
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    void release(size_t mark);
+};
+
+class ArenaScope {
+public:
+    ArenaScope() : arena(Arena::current()), mark(arena.used) { arena.depth++; }
+    ~ArenaScope() { arena.release(mark); }
+
+private:
+    Arena& arena;
+    size_t mark;
+
+    ArenaScope(const ArenaScope&);
+    ArenaScope& operator=(const ArenaScope&);
+};
+
+#endif // ARENA_H
@@ -0,0 +1,447 @@
+// End-to-end benchmark: generates a seeded workload in the README's command
+// mix and runs it through TicketSystem in process.
+//     ticket_bench [commands] [seed] [--emit]
+// Reports throughput, per-command latency (the stats command's table) and
+// peak RSS. --emit prints the generated command stream instead of running
+// it, so the same workload can be piped into code or ticket_client.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "ticket_system.h"
+#include "stats.h"
+
+namespace {
+
+const int HUB_COUNT = 8;
+const int SPOKE_COUNT = 400;
+const int STATION_TOTAL = HUB_COUNT + SPOKE_COUNT;
+const int SETUP_USERS = 300;
+const int SETUP_LOGINS = 100;
+const int SETUP_TRAINS = 200;
+const int SEASON_DAYS = 92;  // 06-01 .. 08-31
+
+unsigned long long rngState;
+
+unsigned nextRandom() {
+    rngState = rngState * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned)(rngState >> 33);
+}
+
+double nowSeconds() {
+    return CommandStats::nowNanos() * 1e-9;
+}
+
+// VmHWM from /proc/self/status, in bytes (0 if unavailable)
+long long peakRssBytes() {
+    FILE* file = fopen("/proc/self/status", "r");
+    if (!file) return 0;
+
+    char line[256];
+    long long kb = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            kb = atoll(line + 6);
+            break;
+        }
+    }
+    fclose(file);
+    return kb * 1024;
+}
+
+// Hubs are 枢 plus two digits, spokes three digits, all in Chinese
+// numerals so names stay within the 3-character station field
+void stationName(int station, char* name) {
+    static const char* const DIGITS[] = {"零", "一", "二", "三", "四", "五", "六", "七", "八", "九"};
+    if (station < HUB_COUNT) {
+        sprintf(name, "枢%s%s", DIGITS[station / 10], DIGITS[station % 10]);
+    } else {
+        int spoke = station - HUB_COUNT;
+        sprintf(name, "%s%s%s", DIGITS[spoke / 100], DIGITS[spoke / 10 % 10], DIGITS[spoke % 10]);
+    }
+}
+
+// User 0 is the root account created first
+void userName(int user, char* name) {
+    if (user == 0) {
+        strcpy(name, "root");
+    } else {
+        sprintf(name, "user%d", user);
+    }
+}
+
+void userPassword(int user, char* password) {
+    if (user == 0) {
+        strcpy(password, "rootpass");
+    } else {
+        sprintf(password, "password%d", user);
+    }
+}
+
+// Day 0 is 06-01; out of range days clamp to the season. date holds
+// at least 6 bytes.
+void seasonDate(int day, char* date) {
+    if (day < 0) day = 0;
+    if (day >= SEASON_DAYS) day = SEASON_DAYS - 1;
+    int month = 6;
+    if (day >= 61) {
+        month = 8;
+        day -= 61;
+    } else if (day >= 30) {
+        month = 7;
+        day -= 30;
+    }
+    snprintf(date, 6, "%02d-%02d", month, day + 1);
+}
+
+struct BenchTrain {
+    int stationCount;
+    int stations[MAX_STATIONS];
+    int firstDay, lastDay;
+    bool released, deleted;
+};
+
+enum CommandKind {
+    QUERY_PROFILE, QUERY_TICKET, BUY_TICKET,                 // SF
+    LOGIN, LOGOUT, MODIFY_PROFILE, QUERY_ORDER,              // F
+    ADD_USER, ADD_TRAIN, RELEASE_TRAIN, QUERY_TRAIN,         // N
+    DELETE_TRAIN, QUERY_TRANSFER, REFUND_TICKET,
+    KIND_COUNT
+};
+
+// Relative frequencies from the README: SF ~10^6, F ~10^5, N ~10^4.
+// clean and exit (R) are left out so the run keeps its data.
+const int KIND_WEIGHT[KIND_COUNT] = {100, 100, 100, 10, 10, 10, 10, 1, 1, 1, 1, 1, 1, 1};
+
+// Tracks just enough state to keep most commands meaningful
+class Workload {
+private:
+    BenchTrain trains[MAX_TRAINS];
+    int trainCount;
+    int userCount;
+    bool loggedIn[MAX_USERS];
+    int loggedUsers[MAX_USERS];
+    int loggedCount;
+    int weightTotal;
+    int setupStep;
+
+    int pickLogged() { return loggedCount ? loggedUsers[nextRandom() % loggedCount] : 0; }
+    int pickTrain(bool released);
+    void login(int user);
+    void logout(int user);
+    void pickTrip(int& from, int& to);
+    void buildTrain(BenchTrain& train);
+    int addTrain(char* command);
+
+public:
+    Workload();
+
+    // Writes the setup commands, one per call, until it returns false
+    bool nextSetup(char* command);
+    void next(char* command);
+};
+
+Workload::Workload() : trainCount(0), userCount(0), loggedCount(0), weightTotal(0), setupStep(0) {
+    memset(loggedIn, 0, sizeof(loggedIn));
+    for (int i = 0; i < KIND_COUNT; i++) weightTotal += KIND_WEIGHT[i];
+}
+
+int Workload::pickTrain(bool released) {
+    // A few probes for a live train in the wanted state, else any train
+    for (int attempt = 0; attempt < 8; attempt++) {
+        int t = nextRandom() % trainCount;
+        if (!trains[t].deleted && trains[t].released == released) return t;
+    }
+    return nextRandom() % trainCount;
+}
+
+void Workload::login(int user) {
+    if (loggedIn[user]) return;
+    loggedIn[user] = true;
+    loggedUsers[loggedCount++] = user;
+}
+
+void Workload::logout(int user) {
+    if (!loggedIn[user]) return;
+    loggedIn[user] = false;
+    for (int i = 0; i < loggedCount; i++) {
+        if (loggedUsers[i] == user) {
+            loggedUsers[i] = loggedUsers[--loggedCount];
+            break;
+        }
+    }
+}
+
+void Workload::pickTrip(int& from, int& to) {
+    // Mostly station pairs some train serves, the rest arbitrary
+    if (nextRandom() % 10 < 8) {
+        const BenchTrain& train = trains[pickTrain(true)];
+        int i = nextRandom() % (train.stationCount - 1);
+        int j = i + 1 + nextRandom() % (train.stationCount - 1 - i);
+        from = train.stations[i];
+        to = train.stations[j];
+    } else {
+        from = nextRandom() % STATION_TOTAL;
+        do {
+            to = nextRandom() % STATION_TOTAL;
+        } while (to == from);
+    }
+}
+
+void Workload::buildTrain(BenchTrain& train) {
+    // Mostly short routes, some long ones, up to the 100-station limit
+    unsigned roll = nextRandom() % 100;
+    int length = roll < 70 ? 2 + nextRandom() % 14 : roll < 95 ? 16 + nextRandom() % 35 : 51 + nextRandom() % 50;
+
+    // Spokes feed into a hub every few stops, so hub pairs are shared by
+    // many trains
+    static int seen[STATION_TOTAL];
+    static int stamp = 0;
+    stamp++;
+    for (int i = 0; i < length; i++) {
+        int station;
+        do {
+            bool hub = i % 6 == 3 || (length < 6 && i == length / 2);
+            station = hub ? nextRandom() % HUB_COUNT : HUB_COUNT + nextRandom() % SPOKE_COUNT;
+            // Every hub already on the route: fall back to a spoke
+            if (hub && seen[station] == stamp) station = HUB_COUNT + nextRandom() % SPOKE_COUNT;
+        } while (seen[station] == stamp);
+        seen[station] = stamp;
+        train.stations[i] = station;
+    }
+    train.stationCount = length;
+    train.firstDay = nextRandom() % 61;
+    train.lastDay = train.firstDay + nextRandom() % (SEASON_DAYS - train.firstDay);
+    train.released = false;
+    train.deleted = false;
+}
+
+int Workload::addTrain(char* command) {
+    if (trainCount == MAX_TRAINS) {
+        // Table full: a duplicate ID, which is rejected
+        return sprintf(command, "add_train -i B%d -n 2 -m 100 -s 枢零零|枢零一 -p 1 -x 00:00 -t 1 -o _ -d 06-01|08-31 -y G",
+                       nextRandom() % trainCount);
+    }
+
+    BenchTrain& train = trains[trainCount];
+    buildTrain(train);
+
+    char* ptr = command;
+    ptr += sprintf(ptr, "add_train -i B%d -n %d -m %u -s ", trainCount, train.stationCount,
+                   100 + nextRandom() % 100000);
+    for (int i = 0; i < train.stationCount; i++) {
+        char name[16];
+        stationName(train.stations[i], name);
+        ptr += sprintf(ptr, i ? "|%s" : "%s", name);
+    }
+    ptr += sprintf(ptr, " -p ");
+    for (int i = 0; i + 1 < train.stationCount; i++) {
+        ptr += sprintf(ptr, i ? "|%u" : "%u", 1 + nextRandom() % 1000);
+    }
+    ptr += sprintf(ptr, " -x %02u:%02u -t ", nextRandom() % 24, nextRandom() % 60);
+    for (int i = 0; i + 1 < train.stationCount; i++) {
+        ptr += sprintf(ptr, i ? "|%u" : "%u", 10 + nextRandom() % 600);
+    }
+    ptr += sprintf(ptr, " -o ");
+    if (train.stationCount == 2) ptr += sprintf(ptr, "_");
+    for (int i = 1; i + 1 < train.stationCount; i++) {
+        ptr += sprintf(ptr, i > 1 ? "|%u" : "%u", 1 + nextRandom() % 20);
+    }
+    char first[8], last[8];
+    seasonDate(train.firstDay, first);
+    seasonDate(train.lastDay, last);
+    ptr += sprintf(ptr, " -d %s|%s -y %c", first, last, "GDCZTK"[nextRandom() % 6]);
+
+    trainCount++;
+    return ptr - command;
+}
+
+bool Workload::nextSetup(char* command) {
+    int s = setupStep++;
+
+    if (s == 0) {
+        sprintf(command, "add_user -c root -u root -p rootpass -n 管理员 -m root@ticket.cn -g 10");
+        userCount = 1;
+        return true;
+    }
+    if (s == 1) {
+        sprintf(command, "login -u root -p rootpass");
+        login(0);
+        return true;
+    }
+    s -= 2;
+    if (s < SETUP_USERS) {
+        sprintf(command, "add_user -c root -u user%d -p password%d -n 乘客 -m user%d@ticket.cn -g %u",
+                userCount, userCount, userCount, 1 + nextRandom() % 9);
+        userCount++;
+        return true;
+    }
+    s -= SETUP_USERS;
+    if (s < SETUP_LOGINS) {
+        int user = 1 + s;
+        sprintf(command, "login -u user%d -p password%d", user, user);
+        login(user);
+        return true;
+    }
+    s -= SETUP_LOGINS;
+    if (s < SETUP_TRAINS * 2) {
+        if (s % 2 == 0) {
+            addTrain(command);
+        } else {
+            sprintf(command, "release_train -i B%d", trainCount - 1);
+            trains[trainCount - 1].released = true;
+        }
+        return true;
+    }
+    return false;
+}
+
+void Workload::next(char* command) {
+    unsigned roll = nextRandom() % weightTotal;
+    int kind = 0;
+    while (roll >= (unsigned)KIND_WEIGHT[kind]) roll -= KIND_WEIGHT[kind++];
+
+    char date[8], fromName[16], toName[16], user[16], password[32];
+    seasonDate(nextRandom() % SEASON_DAYS, date);
+    int from, to;
+    int account = pickLogged();
+    userName(account, user);
+
+    switch (kind) {
+    case QUERY_PROFILE:
+        sprintf(command, "query_profile -c %s -u user%u", user, 1 + nextRandom() % (userCount - 1));
+        break;
+    case QUERY_TICKET:
+    case QUERY_TRANSFER:
+        pickTrip(from, to);
+        stationName(from, fromName);
+        stationName(to, toName);
+        sprintf(command, "%s -s %s -t %s -d %s -p %s", kind == QUERY_TICKET ? "query_ticket" : "query_transfer",
+                fromName, toName, date, nextRandom() % 2 ? "time" : "cost");
+        break;
+    case BUY_TICKET: {
+        int t = pickTrain(true);
+        const BenchTrain& train = trains[t];
+        int i = nextRandom() % (train.stationCount - 1);
+        int j = i + 1 + nextRandom() % (train.stationCount - 1 - i);
+        stationName(train.stations[i], fromName);
+        stationName(train.stations[j], toName);
+        seasonDate(train.firstDay + nextRandom() % (train.lastDay - train.firstDay + 1), date);
+        sprintf(command, "buy_ticket -u %s -i B%d -d %s -n %u -f %s -t %s -q %s", user, t, date,
+                1 + nextRandom() % 5, fromName, toName, nextRandom() % 4 ? "false" : "true");
+        break;
+    }
+    case LOGIN:
+        account = nextRandom() % userCount;
+        userName(account, user);
+        userPassword(account, password);
+        sprintf(command, "login -u %s -p %s", user, password);
+        login(account);
+        break;
+    case LOGOUT:
+        sprintf(command, "logout -u %s", user);
+        logout(account);
+        break;
+    case MODIFY_PROFILE:
+        if (nextRandom() % 2) {
+            sprintf(command, "modify_profile -c %s -u %s -m %s_%u@ticket.cn", user, user, user, nextRandom() % 100);
+        } else {
+            sprintf(command, "modify_profile -c %s -u %s -n 旅客", user, user);
+        }
+        break;
+    case QUERY_ORDER:
+        sprintf(command, "query_order -u %s", user);
+        break;
+    case ADD_USER:
+        if (userCount < MAX_USERS) {
+            sprintf(command, "add_user -c %s -u user%d -p password%d -n 乘客 -m user%d@ticket.cn -g 1",
+                    user, userCount, userCount, userCount);
+            userCount++;
+        } else {
+            sprintf(command, "add_user -c root -u user1 -p password1 -n 乘客 -m user1@ticket.cn -g 1");
+        }
+        break;
+    case ADD_TRAIN:
+        addTrain(command);
+        break;
+    case RELEASE_TRAIN: {
+        int t = pickTrain(false);
+        sprintf(command, "release_train -i B%d", t);
+        if (!trains[t].deleted) trains[t].released = true;
+        break;
+    }
+    case QUERY_TRAIN:
+        sprintf(command, "query_train -i B%u -d %s", nextRandom() % trainCount, date);
+        break;
+    case DELETE_TRAIN: {
+        int t = pickTrain(false);
+        sprintf(command, "delete_train -i B%d", t);
+        if (!trains[t].released) trains[t].deleted = true;
+        break;
+    }
+    case REFUND_TICKET:
+        sprintf(command, "refund_ticket -u %s -n %u", user, 1 + nextRandom() % 3);
+        break;
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    long long commands = 347000;
+    rngState = 1;
+    bool emit = false;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--emit") == 0) {
+            emit = true;
+        } else if (positional++ == 0) {
+            commands = atoll(argv[i]);
+        } else {
+            rngState = strtoull(argv[i], nullptr, 10);
+        }
+    }
+
+    static Workload workload;
+    static TicketSystem system;
+    static char command[MAX_COMMAND_LEN];
+    OutputBuffer out;
+    long long replyBytes = 0;
+
+    // Setup is untimed; the stats table still includes it
+    int setupCommands = 0;
+    while (workload.nextSetup(command)) {
+        setupCommands++;
+        if (emit) {
+            printf("%s\n", command);
+        } else {
+            system.processCommand(command, out);
+            out.clear();
+        }
+    }
+
+    double elapsed = 0;
+    for (long long i = 0; i < commands; i++) {
+        workload.next(command);
+        if (emit) {
+            printf("%s\n", command);
+            continue;
+        }
+        double start = nowSeconds();
+        system.processCommand(command, out);
+        elapsed += nowSeconds() - start;
+        replyBytes += out.size();
+        out.clear();
+    }
+    if (emit) return 0;
+
+    printf("setup commands:   %d\n", setupCommands);
+    printf("commands:         %lld\n", commands);
+    printf("reply bytes:      %lld\n", replyBytes);
+    printf("elapsed:          %.3f s\n", elapsed);
+    printf("throughput:       %.0f commands/s\n", elapsed > 0 ? commands / elapsed : 0.0);
+    printf("peak RSS:         %.1f MiB\n", peakRssBytes() / 1048576.0);
+
+    CommandStats::instance().report(out);
+    fwrite(out.data(), 1, out.size(), stdout);
+    return 0;
+}
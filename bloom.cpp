@@ -0,0 +1,75 @@
+#include "bloom.h"
+#include <cstring>
+
+BloomFilter::BloomFilter(int expectedKeys) : generation(1), keyCount(0) {
+    allocate(bitsFor(expectedKeys));
+}
+
+BloomFilter::~BloomFilter() {
+    delete[] bits;
+    delete[] wordGeneration;
+}
+
+unsigned int BloomFilter::bitsFor(int expectedKeys) {
+    unsigned int bitTotal = 64;
+    while (bitTotal < (unsigned int)expectedKeys * 10) bitTotal <<= 1;
+    return bitTotal;
+}
+
+void BloomFilter::allocate(unsigned int bitTotal) {
+    mask = bitTotal - 1;
+    bits = new unsigned long long[bitTotal / 64];
+    wordGeneration = new unsigned int[bitTotal / 64];
+    memset(wordGeneration, 0, sizeof(unsigned int) * (bitTotal / 64));
+}
+
+void BloomFilter::resize(int expectedKeys) {
+    delete[] bits;
+    delete[] wordGeneration;
+    allocate(bitsFor(expectedKeys > MIN_KEYS ? expectedKeys : MIN_KEYS));
+    generation = 1;
+    keyCount = 0;
+}
+
+void BloomFilter::hash(const char* key, unsigned int& h1, unsigned int& h2) {
+    // 64-bit FNV-1a, split into two halves for double hashing
+    unsigned long long h = 14695981039346656037ULL;
+    for (const char* p = key; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 1099511628211ULL;
+    }
+    h1 = (unsigned int)h;
+    h2 = (unsigned int)(h >> 32) | 1;
+}
+
+void BloomFilter::insert(const char* key) {
+    unsigned int h1, h2;
+    hash(key, h1, h2);
+    for (int i = 0; i < PROBES; i++) {
+        unsigned int bit = (h1 + i * h2) & mask;
+        unsigned int index = bit >> 6;
+        bits[index] = word(index) | (1ULL << (bit & 63));
+        wordGeneration[index] = generation;
+    }
+    keyCount++;
+}
+
+bool BloomFilter::mightContain(const char* key) const {
+    unsigned int h1, h2;
+    hash(key, h1, h2);
+    for (int i = 0; i < PROBES; i++) {
+        unsigned int bit = (h1 + i * h2) & mask;
+        if (!(word(bit >> 6) & (1ULL << (bit & 63)))) return false;
+    }
+    return true;
+}
+
+void BloomFilter::clear() {
+    generation++;
+    if (generation == 0) {
+        // Wrapped around: stamps from 2^32 clears ago would look current
+        memset(wordGeneration, 0, sizeof(unsigned int) * ((mask + 1) / 64));
+        generation = 1;
+    }
+    keyCount = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include "utils.h"
+
+// Bloom filter over ID strings, used to answer "definitely absent" before a
+// manager scans its records. Bits are sized from the expected record count
+// (about 10 bits per key, 7 probes, ~1% false positives). The filter holds
+// no data of its own: the owner rebuilds it from the records after deletes
+// or loads, and resizes it once the keys outgrow capacity().
+//
+// Each word carries the generation it was last written in, so clear() just
+// bumps the generation and stale words read as zero until rewritten.
+class BloomFilter {
+private:
+    unsigned long long* bits;
+    unsigned int* wordGeneration;
+    unsigned int generation;
+    unsigned int mask;      // bit count - 1 (bit count is a power of two)
+    int keyCount;
+
+    static const int PROBES = 7;
+
+    static void hash(const char* key, unsigned int& h1, unsigned int& h2);
+    static unsigned int bitsFor(int expectedKeys);
+    void allocate(unsigned int bitTotal);
+
+    unsigned long long word(unsigned int index) const {
+        return wordGeneration[index] == generation ? bits[index] : 0;
+    }
+
+public:
+    static const int MIN_KEYS = 256;  // smallest size resize() allocates
+
+    explicit BloomFilter(int expectedKeys);
+    ~BloomFilter();
+
+    void insert(const char* key);
+    bool mightContain(const char* key) const;
+    void clear();
+
+    // Reallocates for expectedKeys (at least MIN_KEYS) and clears; the
+    // owner reinserts its keys afterwards
+    void resize(int expectedKeys);
+
+    int size() const { return keyCount; }
+    int capacity() const { return (int)((mask + 1) / 10); }  // keys within the ~1% rate
+    int bitCount() const { return (int)mask + 1; }
+
+private:
+    BloomFilter(const BloomFilter&);
+    BloomFilter& operator=(const BloomFilter&);
+};
+
+#endif // BLOOM_H
@@ -0,0 +1,98 @@
+#include "capture.h"
+#include <cstring>
+
+namespace {
+
+const char CAPTURE_MAGIC[8] = {'T', 'K', 'C', 'A', 'P', 'T', '0', '1'};
+
+} // namespace
+
+bool CaptureWriter::open(const char* path, int sessionFlags) {
+    file = fopen(path, "ab");
+    if (!file) return false;
+
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0) fwrite(CAPTURE_MAGIC, 1, sizeof(CAPTURE_MAGIC), file);
+    fputc(CAPTURE_SESSION, file);
+    fputc(sessionFlags, file);
+    return true;
+}
+
+void CaptureWriter::writeVarint(unsigned int value) {
+    while (value >= 0x80) {
+        fputc((value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+    fputc(value, file);
+}
+
+void CaptureWriter::record(const char* command, const char* reply, int replyLength) {
+    if (!file) return;
+    int commandLength = strlen(command);
+    fputc(CAPTURE_COMMAND, file);
+    writeVarint(commandLength);
+    fwrite(command, 1, commandLength, file);
+    writeVarint(replyLength);
+    fwrite(reply, 1, replyLength, file);
+}
+
+void CaptureWriter::close() {
+    if (file) fclose(file);
+    file = nullptr;
+}
+
+CaptureReader::CaptureReader() : file(nullptr), sessionFlags(0) {
+    command = new char[MAX_COMMAND_LEN + 1];
+    command[0] = '\0';
+}
+
+CaptureReader::~CaptureReader() {
+    if (file) fclose(file);
+    delete[] command;
+}
+
+bool CaptureReader::open(const char* path) {
+    file = fopen(path, "rb");
+    if (!file) return false;
+    char magic[sizeof(CAPTURE_MAGIC)];
+    return fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+           memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool CaptureReader::readVarint(unsigned int& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int byte = fgetc(file);
+        if (byte == EOF) return false;
+        value |= (unsigned int)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+int CaptureReader::next() {
+    int kind = fgetc(file);
+    if (kind == EOF) return 0;
+
+    if (kind == CAPTURE_SESSION) {
+        sessionFlags = fgetc(file);
+        return sessionFlags == EOF ? -1 : CAPTURE_SESSION;
+    }
+    if (kind != CAPTURE_COMMAND) return -1;
+
+    unsigned int length;
+    if (!readVarint(length) || length > MAX_COMMAND_LEN ||
+        fread(command, 1, length, file) != length) return -1;
+    command[length] = '\0';
+
+    if (!readVarint(length)) return -1;
+    reply.clear();
+    char chunk[4096];
+    while (length > 0) {
+        unsigned int n = length < sizeof(chunk) ? length : sizeof(chunk);
+        if (fread(chunk, 1, n, file) != n) return -1;
+        reply.write(chunk, n);
+        length -= n;
+    }
+    return CAPTURE_COMMAND;
+}
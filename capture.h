@@ -0,0 +1,68 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <cstdio>
+#include "utils.h"
+
+// Binary capture of a command stream with the replies it produced, for
+// replaying against later builds (see replay.cpp). The file starts with
+// an 8-byte magic and holds a sequence of records:
+//     SESSION  kind byte, flags byte        -- a process (re)start
+//     COMMAND  kind byte, varint command length, command bytes,
+//              varint reply length, reply bytes
+// Every process appends to the same file, so restarts show up as
+// SESSION records between command runs.
+enum CaptureRecordKind {
+    CAPTURE_SESSION = 1,
+    CAPTURE_COMMAND = 2
+};
+
+// SESSION flags
+const int CAPTURE_CHECKPOINTED = 1;  // the process persisted through --checkpoint
+
+class CaptureWriter {
+private:
+    FILE* file;
+
+    void writeVarint(unsigned int value);
+
+    CaptureWriter(const CaptureWriter&);
+    CaptureWriter& operator=(const CaptureWriter&);
+
+public:
+    CaptureWriter() : file(nullptr) {}
+    ~CaptureWriter() { close(); }
+
+    // Opens for appending and records the start of a session
+    bool open(const char* path, int sessionFlags);
+    void record(const char* command, const char* reply, int replyLength);
+    void close();
+};
+
+class CaptureReader {
+private:
+    FILE* file;
+    char* command;
+    OutputBuffer reply;
+    int sessionFlags;
+
+    bool readVarint(unsigned int& value);
+
+    CaptureReader(const CaptureReader&);
+    CaptureReader& operator=(const CaptureReader&);
+
+public:
+    CaptureReader();
+    ~CaptureReader();
+
+    bool open(const char* path);
+
+    // Returns the next record's kind, 0 at the end, -1 on a corrupt file.
+    // The accessors describe the record just read.
+    int next();
+    int flags() const { return sessionFlags; }
+    const char* commandText() const { return command; }
+    const OutputBuffer& expectedReply() const { return reply; }
+};
+
+#endif // CAPTURE_H
@@ -0,0 +1,180 @@
+#include "checkpoint.h"
+#include "ring_file.h"
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'T', 'K', 'S', 'N', 'A', 'P', '0', '6'};
+
+// Header: magic, generation of the current data, generation of the snapshot body
+struct SnapshotHeader {
+    char magic[8];
+    unsigned int currentGeneration;
+    unsigned int dataGeneration;
+};
+
+} // namespace
+
+Checkpointer::Checkpointer(const char* checkpointPath)
+    : writer(-1), mutationsSinceSnapshot(0), completed(0) {
+    snprintf(path, sizeof(path), "%s", checkpointPath);
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+    snprintf(lockPath, sizeof(lockPath), "%s.lock", path);
+}
+
+bool Checkpointer::load(TicketSystem& system) {
+    // A writer from a previous run may still be finishing; wait for it
+    int lockFd = open(lockPath, O_RDWR | O_CREAT, 0644);
+    if (lockFd != -1) flock(lockFd, LOCK_SH);
+
+    bool loaded = false;
+    int fd = open(path, O_RDONLY);
+    if (fd != -1) {
+        {
+            SnapshotHeader header;
+            RingFile file(fd);
+            if (file.read(&header, sizeof(header)) &&
+                memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0) {
+                // A body from an older generation was cleaned away
+                if (header.dataGeneration == header.currentGeneration) {
+                    loaded = system.load(file);
+                    if (!loaded) system.clear();
+                }
+                system.setGeneration(header.currentGeneration);
+            }
+        }
+        close(fd);
+    }
+
+    if (lockFd != -1) close(lockFd);
+    return loaded;
+}
+
+bool Checkpointer::writeSnapshot(TicketSystem& system, int lockFd) {
+    bool ok = false;
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd != -1) {
+        SnapshotHeader header;
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.currentGeneration = header.dataGeneration = system.getGeneration();
+        {
+            RingFile file(fd);
+            ok = file.write(&header, sizeof(header)) &&
+                 system.save(file) &&
+                 file.sync();
+        }
+        close(fd);
+        ok = ok && rename(tempPath, path) == 0;
+    }
+
+    // Make the rename itself durable before releasing the lock
+    if (ok) {
+        char dir[256];
+        snprintf(dir, sizeof(dir), "%s", path);
+        char* slash = strrchr(dir, '/');
+        if (slash) {
+            *(slash == dir ? slash + 1 : slash) = '\0';
+        } else {
+            strcpy(dir, ".");
+        }
+        int dirFd = open(dir, O_RDONLY);
+        if (dirFd != -1) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+    }
+
+    close(lockFd);
+    return ok;
+}
+
+void Checkpointer::noteMutation(TicketSystem& system) {
+    mutationsSinceSnapshot++;
+    if (mutationsSinceSnapshot >= CHECKPOINT_INTERVAL) {
+        start(system);
+    }
+}
+
+void Checkpointer::noteCommand(TicketSystem& system, const char* command) {
+    if (strcmp(command, "exit") == 0 || strncmp(command, "exit ", 5) == 0) {
+        start(system);
+    } else if (strcmp(command, "clean") == 0 || strncmp(command, "clean ", 6) == 0) {
+        noteClean(system);
+        noteMutation(system);
+    } else {
+        noteMutation(system);
+    }
+}
+
+void Checkpointer::noteClean(TicketSystem& system) {
+    // The running writer's image predates the clean; landing it later
+    // would bring the old data back
+    if (writer != -1) {
+        kill(writer, SIGKILL);
+        int status;
+        while (waitpid(writer, &status, 0) == -1 && errno == EINTR) {}
+        writer = -1;
+    }
+
+    int fd = open(path, O_WRONLY);
+    if (fd == -1) return;  // nothing stored yet
+    unsigned int generation = system.getGeneration();
+    if (pwrite(fd, &generation, sizeof(generation), offsetof(SnapshotHeader, currentGeneration)) ==
+        (ssize_t)sizeof(generation)) {
+        fdatasync(fd);
+    }
+    close(fd);
+}
+
+bool Checkpointer::start(TicketSystem& system) {
+    poll();
+    if (writer != -1) return true;  // the next interval will pick up these changes
+
+    // Locked before the fork, so a restart after this process exits always
+    // waits for the child; the child inherits the lock and drops it last
+    int lockFd = open(lockPath, O_RDWR | O_CREAT, 0644);
+    if (lockFd == -1) return false;
+    if (flock(lockFd, LOCK_EX) == -1) {
+        close(lockFd);
+        return false;
+    }
+
+    fflush(stdout);  // the child must not flush the parent's pending output again
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Child: the copy-on-write image is frozen at the fork point
+        _exit(writeSnapshot(system, lockFd) ? 0 : 1);
+    }
+    close(lockFd);
+    if (pid == -1) return false;
+
+    writer = pid;
+    mutationsSinceSnapshot = 0;
+    return true;
+}
+
+void Checkpointer::poll() {
+    if (writer == -1) return;
+    int status;
+    pid_t done = waitpid(writer, &status, WNOHANG);
+    if (done == writer) {
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) completed++;
+        writer = -1;
+    }
+}
+
+void Checkpointer::wait() {
+    if (writer == -1) return;
+    int status;
+    while (waitpid(writer, &status, 0) == -1 && errno == EINTR) {}
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) completed++;
+    writer = -1;
+}
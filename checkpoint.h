@@ -0,0 +1,67 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "ticket_system.h"
+#include <sys/types.h>
+
+// Mutating commands between two background checkpoints
+const int CHECKPOINT_INTERVAL = 10000;
+
+// Fork-based snapshots of the whole system. start() forks; the child
+// inherits a copy-on-write image of every manager, writes it to a
+// temporary file, fsyncs and renames it over the checkpoint, while the
+// parent goes straight back to serving commands. The pause in the parent
+// is the fork itself, independent of how much data is stored.
+//
+// The file starts with two generation words: the generation the data was
+// written in, and the current generation. clean only rewrites the latter
+// (a few bytes at a fixed offset), which marks the stored data stale no
+// matter how large it is; load treats a mismatch as an empty system.
+//
+// start() takes an exclusive flock on "<path>.lock" before forking and
+// the child holds it until its rename is durable, so a restart that races
+// a still-running child waits for it instead of loading a stale snapshot.
+class Checkpointer {
+private:
+    char path[256];
+    char tempPath[264];
+    char lockPath[264];
+    pid_t writer;          // running child, or -1
+    int mutationsSinceSnapshot;
+    int completed;         // snapshots known to be durable
+
+    // Runs in the child; releases the inherited lock when done
+    bool writeSnapshot(TicketSystem& system, int lockFd);
+
+public:
+    explicit Checkpointer(const char* path);
+
+    // Restores the last durable snapshot; returns false if there is none
+    bool load(TicketSystem& system);
+
+    // Counts a mutating command and starts a snapshot every CHECKPOINT_INTERVAL
+    void noteMutation(TicketSystem& system);
+
+    // Reacts to a mutating command that has just run: exit snapshots,
+    // clean marks the snapshot stale, anything else is noteMutation
+    void noteCommand(TicketSystem& system, const char* command);
+
+    // Marks the stored snapshot stale after a clean, in constant time.
+    // A writer still holding pre-clean data is abandoned first.
+    void noteClean(TicketSystem& system);
+
+    // Starts a background snapshot unless one is already running; returns
+    // false if the fork failed
+    bool start(TicketSystem& system);
+
+    // Reaps a finished writer without blocking
+    void poll();
+
+    // Blocks until the running writer (if any) is done
+    void wait();
+
+    bool isDirty() const { return mutationsSinceSnapshot > 0; }
+    int completedSnapshots() const { return completed; }
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,100 @@
+// Stdin-compatible frontend for the server mode: forwards commands from
+// stdin to the socket and copies replies to stdout, so
+//     ticket_client <socket> < input.txt
+// prints exactly what `code < input.txt` would.
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int connectToServer(const char* socketPath) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool writeAll(int fd, const char* data, int length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <socket path>\n", argv[0]);
+        return 1;
+    }
+
+    int fd = connectToServer(argv[1]);
+    if (fd == -1) {
+        perror("connect");
+        return 1;
+    }
+
+    static char input[1 << 16], reply[1 << 16];
+    int inputLength = 0, inputSent = 0;
+    bool inputOpen = true;
+
+    // Pump both directions and only forward input when the socket can take
+    // it, so a long pipelined input never deadlocks against replies the
+    // server is waiting to send
+    while (true) {
+        bool pending = inputSent < inputLength;
+        pollfd fds[2];
+        fds[0].fd = fd;
+        fds[0].events = POLLIN | (pending ? POLLOUT : 0);
+        fds[1].fd = STDIN_FILENO;
+        fds[1].events = POLLIN;
+        if (poll(fds, inputOpen && !pending ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return 1;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(fd, reply, sizeof(reply));
+            if (n <= 0) break;  // server closed: every reply has arrived
+            if (!writeAll(STDOUT_FILENO, reply, n)) return 1;
+        }
+
+        if (pending && (fds[0].revents & POLLOUT)) {
+            ssize_t n = send(fd, input + inputSent, inputLength - inputSent, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("send");
+                return 1;
+            }
+            if (n > 0) inputSent += n;
+        } else if (!pending && inputOpen && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            ssize_t n = read(STDIN_FILENO, input, sizeof(input));
+            if (n <= 0) {
+                shutdown(fd, SHUT_WR);
+                inputOpen = false;
+            } else {
+                inputLength = n;
+                inputSent = 0;
+            }
+        }
+    }
+
+    close(fd);
+    return 0;
+}
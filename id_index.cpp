@@ -0,0 +1,245 @@
+#include "id_index.h"
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+IdIndex::IdIndex(int maxKeys) : spareCount(0), pageCount(0), keyCount(0), capacity(maxKeys) {
+    // Every page holds at least one key
+    maxPages = capacity + 1;
+    pages = new Page*[maxPages];
+    fences = new char[maxPages][MAX_ID_LEN + 1];
+    spare = new Page*[maxPages];
+}
+
+IdIndex::~IdIndex() {
+    clear();
+    for (int i = 0; i < spareCount; i++) delete spare[i];
+    delete[] pages;
+    delete[] fences;
+    delete[] spare;
+}
+
+unsigned char IdIndex::fingerprint(const char* key) {
+    unsigned int h = 2166136261u;
+    for (const char* p = key; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    return (unsigned char)(h ^ (h >> 8) ^ (h >> 16) ^ (h >> 24));
+}
+
+void IdIndex::encodePage(Page* page, char (*keys)[MAX_ID_LEN + 1], const int* values, int n) {
+    // Keys are sorted, so the first and last share the page-wide prefix
+    int prefixLength = 0;
+    while (keys[0][prefixLength] && keys[0][prefixLength] == keys[n - 1][prefixLength]) prefixLength++;
+    memcpy(page->prefix, keys[0], prefixLength);
+    page->prefix[prefixLength] = '\0';
+    page->prefixLength = prefixLength;
+
+    int offset = 0;
+    for (int i = 0; i < n; i++) {
+        int length = strlen(keys[i] + prefixLength);
+        page->suffixOffsets[i] = offset;
+        memcpy(page->suffixes + offset, keys[i] + prefixLength, length);
+        offset += length;
+        page->fingerprints[i] = fingerprint(keys[i]);
+        page->values[i] = values[i];
+    }
+    page->suffixOffsets[n] = offset;
+    page->count = n;
+}
+
+int IdIndex::decodePage(const Page* page, char (*keys)[MAX_ID_LEN + 1], int* values) {
+    for (int i = 0; i < page->count; i++) {
+        int length = page->suffixOffsets[i + 1] - page->suffixOffsets[i];
+        memcpy(keys[i], page->prefix, page->prefixLength);
+        memcpy(keys[i] + page->prefixLength, page->suffixes + page->suffixOffsets[i], length);
+        keys[i][page->prefixLength + length] = '\0';
+        values[i] = page->values[i];
+    }
+    return page->count;
+}
+
+int IdIndex::findInPage(const Page* page, const char* key) {
+    if (strncmp(key, page->prefix, page->prefixLength) != 0) return -1;
+    const char* rest = key + page->prefixLength;
+    int restLength = strlen(rest);
+    unsigned char wanted = fingerprint(key);
+
+#ifdef __SSE2__
+    __m128i needle = _mm_set1_epi8((char)wanted);
+    for (int base = 0; base < page->count; base += 16) {
+        __m128i block = _mm_load_si128((const __m128i*)(page->fingerprints + base));
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (page->count - base < 16) mask &= (1u << (page->count - base)) - 1;
+        while (mask) {
+            int i = base + __builtin_ctz(mask);
+            mask &= mask - 1;
+            int length = page->suffixOffsets[i + 1] - page->suffixOffsets[i];
+            if (length == restLength && memcmp(page->suffixes + page->suffixOffsets[i], rest, length) == 0) {
+                return i;
+            }
+        }
+    }
+#else
+    for (int i = 0; i < page->count; i++) {
+        if (page->fingerprints[i] != wanted) continue;
+        int length = page->suffixOffsets[i + 1] - page->suffixOffsets[i];
+        if (length == restLength && memcmp(page->suffixes + page->suffixOffsets[i], rest, length) == 0) {
+            return i;
+        }
+    }
+#endif
+    return -1;
+}
+
+int IdIndex::pageFor(const char* key) const {
+    int lo = 0, hi = pageCount;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(fences[mid], key) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > 0 ? lo - 1 : 0;
+}
+
+IdIndex::Page* IdIndex::newPage() {
+    return spareCount > 0 ? spare[--spareCount] : new Page();
+}
+
+void IdIndex::insertPage(int position, Page* page) {
+    memmove(pages + position + 1, pages + position, sizeof(Page*) * (pageCount - position));
+    memmove(fences + position + 1, fences + position, sizeof(fences[0]) * (pageCount - position));
+    pages[position] = page;
+    pageCount++;
+}
+
+void IdIndex::removePage(int position) {
+    spare[spareCount++] = pages[position];
+    memmove(pages + position, pages + position + 1, sizeof(Page*) * (pageCount - 1 - position));
+    memmove(fences + position, fences + position + 1, sizeof(fences[0]) * (pageCount - 1 - position));
+    pageCount--;
+}
+
+int IdIndex::find(const char* key) const {
+    if (pageCount == 0) return -1;
+    const Page* page = pages[pageFor(key)];
+    int i = findInPage(page, key);
+    return i == -1 ? -1 : page->values[i];
+}
+
+void IdIndex::prefetch(const char* key) const {
+    if (pageCount == 0) return;
+    const Page* page = pages[pageFor(key)];
+    __builtin_prefetch(page->fingerprints);
+    __builtin_prefetch(page->values);
+    __builtin_prefetch(page->suffixOffsets);
+    __builtin_prefetch(page->prefix);
+}
+
+bool IdIndex::insert(const char* key, int value) {
+    if (keyCount >= capacity || strlen(key) > (size_t)MAX_ID_LEN) return false;
+
+    if (pageCount == 0) {
+        char keys[1][MAX_ID_LEN + 1];
+        strcpy(keys[0], key);
+        insertPage(0, newPage());
+        encodePage(pages[0], keys, &value, 1);
+        strcpy(fences[0], key);
+        keyCount++;
+        return true;
+    }
+
+    int p = pageFor(key);
+    if (findInPage(pages[p], key) != -1) return false;
+
+    // Re-encode the page with the key in place, splitting it when full
+    char keys[PAGE_KEYS + 1][MAX_ID_LEN + 1];
+    int values[PAGE_KEYS + 1];
+    int n = decodePage(pages[p], keys, values);
+    int pos = n;
+    while (pos > 0 && strcmp(keys[pos - 1], key) > 0) pos--;
+    memmove(keys + pos + 1, keys + pos, sizeof(keys[0]) * (n - pos));
+    memmove(values + pos + 1, values + pos, sizeof(int) * (n - pos));
+    strcpy(keys[pos], key);
+    values[pos] = value;
+    n++;
+
+    if (n <= PAGE_KEYS) {
+        encodePage(pages[p], keys, values, n);
+    } else {
+        int half = n / 2;
+        encodePage(pages[p], keys, values, half);
+        insertPage(p + 1, newPage());
+        encodePage(pages[p + 1], keys + half, values + half, n - half);
+        strcpy(fences[p + 1], keys[half]);
+    }
+    strcpy(fences[p], keys[0]);
+    keyCount++;
+    return true;
+}
+
+bool IdIndex::erase(const char* key) {
+    if (pageCount == 0) return false;
+    int p = pageFor(key);
+    int i = findInPage(pages[p], key);
+    if (i == -1) return false;
+
+    char keys[PAGE_KEYS][MAX_ID_LEN + 1];
+    int values[PAGE_KEYS];
+    int n = decodePage(pages[p], keys, values);
+    memmove(keys + i, keys + i + 1, sizeof(keys[0]) * (n - 1 - i));
+    memmove(values + i, values + i + 1, sizeof(int) * (n - 1 - i));
+    n--;
+
+    if (n == 0) {
+        removePage(p);
+    } else {
+        encodePage(pages[p], keys, values, n);
+        strcpy(fences[p], keys[0]);
+    }
+    keyCount--;
+    return true;
+}
+
+bool IdIndex::update(const char* key, int value) {
+    if (pageCount == 0) return false;
+    Page* page = pages[pageFor(key)];
+    int i = findInPage(page, key);
+    if (i == -1) return false;
+    page->values[i] = value;
+    return true;
+}
+
+void IdIndex::build(const char* const* keys, const int* values, int n) {
+    clear();
+    char pageKeys[BUILD_FILL][MAX_ID_LEN + 1];
+    for (int begin = 0; begin < n; begin += BUILD_FILL) {
+        int count = n - begin < BUILD_FILL ? n - begin : BUILD_FILL;
+        for (int i = 0; i < count; i++) strcpy(pageKeys[i], keys[begin + i]);
+        Page* page = newPage();
+        encodePage(page, pageKeys, values + begin, count);
+        strcpy(fences[pageCount], pageKeys[0]);
+        pages[pageCount++] = page;
+    }
+    keyCount = n;
+}
+
+int IdIndex::collect(int* values) const {
+    int n = 0;
+    for (int p = 0; p < pageCount; p++) {
+        memcpy(values + n, pages[p]->values, sizeof(int) * pages[p]->count);
+        n += pages[p]->count;
+    }
+    return n;
+}
+
+void IdIndex::clear() {
+    for (int p = 0; p < pageCount; p++) spare[spareCount++] = pages[p];
+    pageCount = 0;
+    keyCount = 0;
+}
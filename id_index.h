@@ -0,0 +1,70 @@
+#ifndef ID_INDEX_H
+#define ID_INDEX_H
+
+// Longest username or trainID
+const int MAX_ID_LEN = 20;
+
+// Ordered map from ID strings to record slots, for findUser/findTrain.
+// Keys live in pages of up to PAGE_KEYS entries. A page stores the prefix
+// its keys share once and only the remaining suffix of each key, plus a
+// one-byte fingerprint per key. Lookups binary-search a dense array of
+// page fence keys, then compare fingerprints 16 at a time (SSE2, with a
+// scalar fallback) and check the suffix only on a fingerprint match.
+class IdIndex {
+public:
+    static const int PAGE_KEYS = 64;
+    static const int BUILD_FILL = 48;  // keys per page after build(), room to insert
+
+    explicit IdIndex(int capacity);
+    ~IdIndex();
+
+    int find(const char* key) const;           // value, or -1 if absent
+    bool insert(const char* key, int value);   // false if present or full
+    bool erase(const char* key);               // false if absent
+    bool update(const char* key, int value);   // false if absent
+    // Hints the cache lines find(key) will read; changes nothing
+    void prefetch(const char* key) const;
+
+    // Replaces the contents with n keys given in ascending order
+    void build(const char* const* keys, const int* values, int n);
+    // Writes every value in ascending key order; returns how many
+    int collect(int* values) const;
+    void clear();
+
+    int size() const { return keyCount; }
+
+private:
+    struct Page {
+        unsigned char fingerprints[PAGE_KEYS] __attribute__((aligned(16)));
+        int values[PAGE_KEYS];
+        unsigned short suffixOffsets[PAGE_KEYS + 1];  // into suffixes
+        int count;
+        int prefixLength;
+        char prefix[MAX_ID_LEN + 1];
+        char suffixes[PAGE_KEYS * MAX_ID_LEN];
+    };
+
+    Page** pages;
+    char (*fences)[MAX_ID_LEN + 1];  // first key of each page
+    Page** spare;                    // emptied pages, reused before allocating
+    int spareCount;
+    int pageCount;
+    int maxPages;
+    int keyCount;
+    int capacity;
+
+    static unsigned char fingerprint(const char* key);
+    static void encodePage(Page* page, char (*keys)[MAX_ID_LEN + 1], const int* values, int n);
+    static int decodePage(const Page* page, char (*keys)[MAX_ID_LEN + 1], int* values);
+    static int findInPage(const Page* page, const char* key);  // position, or -1
+
+    int pageFor(const char* key) const;  // last page whose fence <= key, or 0
+    Page* newPage();
+    void insertPage(int position, Page* page);
+    void removePage(int position);
+
+    IdIndex(const IdIndex&);
+    IdIndex& operator=(const IdIndex&);
+};
+
+#endif // ID_INDEX_H
@@ -0,0 +1,60 @@
+#include "line_reader.h"
+#include <cstring>
+#include <unistd.h>
+
+bool LineReader::fill() {
+    if (eof) return false;
+    if (start > 0) {
+        memmove(buffer, buffer + start, end - start);
+        end -= start;
+        start = 0;
+    }
+    if (end == BUFFER_SIZE) return false;
+
+    ssize_t n = read(fd, buffer + end, BUFFER_SIZE - end);
+    if (n <= 0) {
+        eof = true;
+        return false;
+    }
+    end += n;
+    return true;
+}
+
+bool LineReader::hasBufferedLine() const {
+    return memchr(buffer + start, '\n', end - start) != nullptr;
+}
+
+const char* LineReader::peekLine(int n, int& length) const {
+    const char* line = buffer + start;
+    const char* bufferEnd = buffer + end;
+    for (;;) {
+        const char* newline = (const char*)memchr(line, '\n', bufferEnd - line);
+        if (!newline) return nullptr;
+        if (n-- == 0) {
+            length = newline - line;
+            return line;
+        }
+        line = newline + 1;
+    }
+}
+
+bool LineReader::readLine(char* line, int maxLen) {
+    char* newline;
+    while (!(newline = (char*)memchr(buffer + start, '\n', end - start))) {
+        if (!fill()) {
+            // Last line without a trailing newline, or a line longer than the buffer
+            if (start == end) return false;
+            newline = buffer + end;
+            break;
+        }
+    }
+
+    int len = newline - (buffer + start);
+    int copied = len < maxLen - 1 ? len : maxLen - 1;
+    memcpy(line, buffer + start, copied);
+    line[copied] = '\0';
+
+    start += len + (newline < buffer + end ? 1 : 0);
+    if (start == end) start = end = 0;
+    return true;
+}
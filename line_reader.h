@@ -0,0 +1,36 @@
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include "utils.h"
+
+// Buffered line reader over a file descriptor. Unlike fgets it can report
+// whether another complete line is already buffered, which lets callers
+// look ahead without blocking on input that has not arrived yet.
+class LineReader {
+private:
+    static const int BUFFER_SIZE = 1 << 16;
+
+    int fd;
+    char buffer[BUFFER_SIZE];
+    int start, end;
+    bool eof;
+
+    bool fill();
+
+public:
+    explicit LineReader(int fd) : fd(fd), start(0), end(0), eof(false) {}
+
+    // Copies the next line (without newline) into line; blocks for input.
+    // Returns false at end of input.
+    bool readLine(char* line, int maxLen);
+
+    // True if a complete line can be returned without blocking
+    bool hasBufferedLine() const;
+
+    // The n-th complete line after the one readLine returns next (n = 0 is
+    // that line), without consuming anything; nullptr if not yet buffered.
+    // The pointer is valid until the next readLine.
+    const char* peekLine(int n, int& length) const;
+};
+
+#endif // LINE_READER_H
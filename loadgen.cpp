@@ -0,0 +1,277 @@
+// Load generator for the server mode: simulates many frontends, each with
+// its own logged-in user, pipelining a query/buy mix over one connection.
+//     ticket_loadgen <socket> [frontends] [commands per frontend] [seed]
+// Reports total throughput and the spread of per-frontend session times.
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "utils.h"
+
+namespace {
+
+// Each frontend logs in as its own user, and root takes one more
+const int MAX_FRONTENDS = MAX_USERS - 1;
+const int TRAIN_COUNT = 100;
+const int STATION_COUNT = 30;
+
+unsigned long long rngState;
+
+unsigned nextRandom() {
+    rngState = rngState * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned)(rngState >> 33);
+}
+
+double nowSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Append-only script of commands for one connection
+struct Script {
+    char* data;
+    int length, capacity;
+    int commands;
+
+    Script() : data(nullptr), length(0), capacity(0), commands(0) {}
+    ~Script() { delete[] data; }
+
+    void add(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+void Script::add(const char* format, ...) {
+    if (capacity - length < 1024) {
+        int newCapacity = capacity ? capacity * 2 : 1 << 16;
+        char* newData = new char[newCapacity];
+        if (length) memcpy(newData, data, length);
+        delete[] data;
+        data = newData;
+        capacity = newCapacity;
+    }
+    va_list args;
+    va_start(args, format);
+    length += vsnprintf(data + length, capacity - length, format, args);
+    va_end(args);
+    commands++;
+}
+
+struct Session {
+    int fd;
+    Script script;
+    int sent;
+    long long received;
+    bool done;
+    double finishedAt;
+};
+
+int connectToServer(const char* socketPath) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void stationName(int station, char* name) {
+    sprintf(name, "S%02d", station);
+}
+
+void buildSetup(Script& setup, int frontends) {
+    setup.add("add_user -c root -u root -p rootpass -n 管理员 -m root@ticket.cn -g 10\n");
+    setup.add("login -u root -p rootpass\n");
+    for (int i = 0; i < frontends; i++) {
+        setup.add("add_user -c root -u user%d -p password%d -n 乘客 -m user%d@ticket.cn -g 1\n", i, i, i);
+    }
+
+    // Trains run along random increasing station sequences, so station
+    // pairs are shared by many trains as on a hub-heavy network
+    for (int t = 0; t < TRAIN_COUNT; t++) {
+        int stations[STATION_COUNT];
+        int count = 0;
+        for (int s = 0; s < STATION_COUNT; s++) {
+            if (nextRandom() % 3 == 0 || s == 0 || s == STATION_COUNT - 1) stations[count++] = s;
+        }
+
+        char list[STATION_COUNT * 4], prices[STATION_COUNT * 8], travel[STATION_COUNT * 8], stopover[STATION_COUNT * 8];
+        char* lp = list; char* pp = prices; char* tp = travel; char* op = stopover;
+        for (int i = 0; i < count; i++) {
+            char name[8];
+            stationName(stations[i], name);
+            lp += sprintf(lp, i ? "|%s" : "%s", name);
+            if (i + 1 < count) {
+                pp += sprintf(pp, i ? "|%u" : "%u", 10 + nextRandom() % 200);
+                tp += sprintf(tp, i ? "|%u" : "%u", 20 + nextRandom() % 180);
+            }
+            if (i > 0 && i + 1 < count) {
+                op += sprintf(op, i > 1 ? "|%u" : "%u", 2 + nextRandom() % 10);
+            }
+        }
+        if (count == 2) strcpy(stopover, "_");
+
+        setup.add("add_train -i G%d -n %d -m %u -s %s -p %s -x %02u:%02u -t %s -o %s -d 06-01|08-31 -y G\n",
+                  1000 + t, count, 500 + nextRandom() % 1000, list, prices,
+                  nextRandom() % 24, nextRandom() % 60, travel, stopover);
+        setup.add("release_train -i G%d\n", 1000 + t);
+    }
+}
+
+void buildSession(Script& script, int user, int commands) {
+    script.add("login -u user%d -p password%d\n", user, user);
+    for (int i = 0; i < commands; i++) {
+        unsigned roll = nextRandom() % 100;
+        int from = nextRandom() % (STATION_COUNT - 1);
+        int to = from + 1 + nextRandom() % (STATION_COUNT - 1 - from);
+        char fromName[8], toName[8];
+        stationName(from, fromName);
+        stationName(to, toName);
+        int month = 6 + nextRandom() % 3;
+        int day = 1 + nextRandom() % 28;
+
+        if (roll < 40) {
+            script.add("query_ticket -s %s -t %s -d %02d-%02d -p %s\n", fromName, toName, month, day,
+                       nextRandom() % 2 ? "time" : "cost");
+        } else if (roll < 70) {
+            script.add("query_profile -c user%d -u user%d\n", user, user);
+        } else if (roll < 90) {
+            script.add("buy_ticket -u user%d -i G%u -d %02d-%02d -n %u -f %s -t %s -q %s\n", user,
+                       1000 + nextRandom() % TRAIN_COUNT, month, day, 1 + nextRandom() % 5,
+                       fromName, toName, nextRandom() % 2 ? "true" : "false");
+        } else {
+            script.add("query_order -u user%d\n", user);
+        }
+    }
+    script.add("logout -u user%d\n", user);
+}
+
+// Drives every session to completion; returns false on a connection error
+bool runSessions(Session* sessions, int count) {
+    static pollfd fds[MAX_FRONTENDS];
+    static int owner[MAX_FRONTENDS];
+    static char reply[1 << 16];
+    int remaining = count;
+
+    while (remaining > 0) {
+        int n = 0;
+        for (int i = 0; i < count; i++) {
+            if (sessions[i].done) continue;
+            fds[n].fd = sessions[i].fd;
+            fds[n].events = POLLIN | (sessions[i].sent < sessions[i].script.length ? POLLOUT : 0);
+            owner[n++] = i;
+        }
+        if (poll(fds, n, -1) < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        for (int k = 0; k < n; k++) {
+            Session& s = sessions[owner[k]];
+            if (fds[k].revents & POLLOUT) {
+                ssize_t w = send(s.fd, s.script.data + s.sent, s.script.length - s.sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (w > 0) s.sent += w;
+                if (s.sent == s.script.length) shutdown(s.fd, SHUT_WR);
+            }
+            if (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t r = read(s.fd, reply, sizeof(reply));
+                if (r > 0) {
+                    s.received += r;
+                } else if (r == 0 || errno != EAGAIN) {
+                    s.done = true;
+                    s.finishedAt = nowSeconds();
+                    close(s.fd);
+                    remaining--;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <socket> [frontends] [commands per frontend] [seed]\n", argv[0]);
+        return 1;
+    }
+    const char* socketPath = argv[1];
+    int frontends = argc > 2 ? atoi(argv[2]) : 200;
+    int commands = argc > 3 ? atoi(argv[3]) : 1000;
+    rngState = argc > 4 ? strtoull(argv[4], nullptr, 10) : 1;
+    if (frontends < 1 || frontends > MAX_FRONTENDS) {
+        fprintf(stderr, "frontends must be in [1, %d]\n", MAX_FRONTENDS);
+        return 1;
+    }
+
+    static Session sessions[MAX_FRONTENDS];
+
+    // Setup runs alone so every frontend starts against the same data
+    buildSetup(sessions[0].script, frontends);
+    sessions[0].fd = connectToServer(socketPath);
+    if (sessions[0].fd == -1 || !runSessions(sessions, 1)) {
+        perror("setup");
+        return 1;
+    }
+    int setupCommands = sessions[0].script.commands;
+    sessions[0].script.length = sessions[0].script.commands = 0;
+
+    long long totalCommands = 0;
+    for (int i = 0; i < frontends; i++) {
+        Session& s = sessions[i];
+        buildSession(s.script, i, commands);
+        totalCommands += s.script.commands;
+        s.sent = 0;
+        s.received = 0;
+        s.done = false;
+    }
+
+    double start = nowSeconds();
+    for (int i = 0; i < frontends; i++) {
+        sessions[i].fd = connectToServer(socketPath);
+        if (sessions[i].fd == -1) {
+            perror("connect");
+            return 1;
+        }
+    }
+    if (!runSessions(sessions, frontends)) {
+        perror("run");
+        return 1;
+    }
+    double elapsed = nowSeconds() - start;
+
+    static double sessionTimes[MAX_FRONTENDS];
+    long long totalBytes = 0;
+    for (int i = 0; i < frontends; i++) {
+        sessionTimes[i] = sessions[i].finishedAt - start;
+        totalBytes += sessions[i].received;
+    }
+    qsort(sessionTimes, frontends, sizeof(double), compareDoubles);
+
+    printf("setup commands:   %d\n", setupCommands);
+    printf("frontends:        %d\n", frontends);
+    printf("commands:         %lld\n", totalCommands);
+    printf("reply bytes:      %lld\n", totalBytes);
+    printf("elapsed:          %.3f s\n", elapsed);
+    printf("throughput:       %.0f commands/s\n", totalCommands / elapsed);
+    printf("session p50/p99/max: %.3f / %.3f / %.3f s\n", sessionTimes[frontends / 2],
+           sessionTimes[(frontends * 99) / 100], sessionTimes[frontends - 1]);
+    return 0;
+}
@@ -0,0 +1,313 @@
+// Micro-benchmarks for individual manager primitives.
+//     ticket_microbench [name filter]
+// Each case is calibrated until one run takes at least MIN_RUN_NANOS, run
+// WARMUP_RUNS times untimed, then REPETITIONS times timed. Reported per
+// operation: min, median, mean and standard deviation in nanoseconds, and
+// the median cycle count (rdtsc where available).
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "ticket_system.h"
+#include "stats.h"
+#include "trace.h"
+#include "arena.h"
+#include "station_index.h"
+
+namespace {
+
+const int WARMUP_RUNS = 3;
+const int REPETITIONS = 15;
+const long long MIN_RUN_NANOS = 2000000;
+
+typedef void (*BenchBody)(void* context, int iterations);
+
+// Results flow here so the compiler cannot drop the measured work
+volatile long long sink;
+
+const char* nameFilter = nullptr;
+
+int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+void runCase(const char* name, int size, BenchBody body, void* context) {
+    if (nameFilter && !strstr(name, nameFilter)) return;
+
+    // Calibrate: double the iteration count until a run is long enough
+    int iterations = 1;
+    for (;;) {
+        long long start = CommandStats::nowNanos();
+        body(context, iterations);
+        if (CommandStats::nowNanos() - start >= MIN_RUN_NANOS || iterations >= (1 << 28)) break;
+        iterations *= 2;
+    }
+
+    for (int i = 0; i < WARMUP_RUNS; i++) body(context, iterations);
+
+    double nanos[REPETITIONS], cycles[REPETITIONS];
+    for (int r = 0; r < REPETITIONS; r++) {
+        long long start = CommandStats::nowNanos();
+        unsigned long long startTicks = traceTicks();
+        body(context, iterations);
+        cycles[r] = (double)(traceTicks() - startTicks) / iterations;
+        nanos[r] = (double)(CommandStats::nowNanos() - start) / iterations;
+    }
+
+    double mean = 0;
+    for (int r = 0; r < REPETITIONS; r++) mean += nanos[r];
+    mean /= REPETITIONS;
+    double variance = 0;
+    for (int r = 0; r < REPETITIONS; r++) variance += (nanos[r] - mean) * (nanos[r] - mean);
+    double stddev = sqrt(variance / (REPETITIONS - 1));
+
+    qsort(nanos, REPETITIONS, sizeof(double), compareDoubles);
+    qsort(cycles, REPETITIONS, sizeof(double), compareDoubles);
+    printf("%-24s %6d %10d %10.1f %10.1f %10.1f %8.1f %10.1f\n", name, size, iterations, nanos[0],
+           nanos[REPETITIONS / 2], mean, stddev, cycles[REPETITIONS / 2]);
+}
+
+// ---- Fixtures ----
+
+const int SIZES[] = {2, 10, 100};
+const int SIZE_COUNT = sizeof(SIZES) / sizeof(SIZES[0]);
+
+struct UserFixture {
+    UserManager* users;
+    char names[MAX_USERS][21];
+    int count;
+};
+
+// count users, looked up round-robin; every other probe misses
+void benchFindUser(void* context, int iterations) {
+    UserFixture* f = (UserFixture*)context;
+    long long found = 0;
+    for (int i = 0; i < iterations; i++) {
+        const char* name = i & 1 ? "absent_user" : f->names[(i >> 1) % f->count];
+        found += f->users->findUser(name) != nullptr;
+    }
+    sink = found;
+}
+
+struct TrainFixture {
+    TrainManager* trains;
+    Train* train;
+    char stations[MAX_STATIONS][11];
+};
+
+void benchStationIndex(void* context, int iterations) {
+    TrainFixture* f = (TrainFixture*)context;
+    long long total = 0;
+    int stationNum = f->train->stationNum;
+    for (int i = 0; i < iterations; i++) {
+        total += f->trains->getStationIndex(f->train, f->stations[i % stationNum]);
+    }
+    sink = total;
+}
+
+void benchCalculatePrice(void* context, int iterations) {
+    TrainFixture* f = (TrainFixture*)context;
+    long long total = 0;
+    int last = f->train->stationNum - 1;
+    for (int i = 0; i < iterations; i++) {
+        total += f->trains->calculatePrice(f->train, 0, last);
+    }
+    sink = total;
+}
+
+void benchMinSeats(void* context, int iterations) {
+    TrainFixture* f = (TrainFixture*)context;
+    long long total = 0;
+    int last = f->train->stationNum - 1;
+    for (int i = 0; i < iterations; i++) {
+        total += f->trains->getMinAvailableSeats(f->train, 0, last);
+    }
+    sink = total;
+}
+
+// Alternates buying and returning one seat over the whole route
+void benchUpdateSeats(void* context, int iterations) {
+    TrainFixture* f = (TrainFixture*)context;
+    long long total = 0;
+    int last = f->train->stationNum - 1;
+    for (int i = 0; i < iterations; i++) {
+        total += f->trains->updateSeats(f->train, 0, last, 1, (i & 1) == 0);
+    }
+    if (iterations & 1) f->trains->updateSeats(f->train, 0, last, 1, false);
+    sink = total;
+}
+
+void benchParseDate(void*, int iterations) {
+    static const char* const DATES[] = {"06-01", "07-15", "08-31", "06-30"};
+    long long total = 0;
+    for (int i = 0; i < iterations; i++) {
+        total += dateToDay(parseDate(DATES[i & 3]));
+    }
+    sink = total;
+}
+
+void benchParseTime(void*, int iterations) {
+    static const char* const TIMES[] = {"00:00", "13:45", "23:59", "07:05"};
+    long long total = 0;
+    for (int i = 0; i < iterations; i++) {
+        Time time = parseTime(TIMES[i & 3]);
+        total += time.hour * 60 + time.minute;
+    }
+    sink = total;
+}
+
+struct ArgsFixture {
+    char args[1024];
+};
+
+void benchParseArgs(void* context, int iterations) {
+    ArgsFixture* f = (ArgsFixture*)context;
+    char* keys[20];
+    char* values[20];
+    long long total = 0;
+    for (int i = 0; i < iterations; i++) {
+        ArenaScope scope;
+        int count;
+        TicketSystem::parseArgs(f->args, keys, values, count);
+        total += count;
+    }
+    sink = total;
+}
+
+struct OrderFixture {
+    OrderManager* orders;
+    char username[21];
+};
+
+void benchQueryOrder(void* context, int iterations) {
+    OrderFixture* f = (OrderFixture*)context;
+    long long total = 0;
+    for (int i = 0; i < iterations; i++) {
+        ArenaScope scope;
+        char* result;
+        total += f->orders->queryOrder(f->username, result);
+        total += result[0];
+    }
+    sink = total;
+}
+
+struct TrainSetFixture {
+    TrainSet a, b, out;
+};
+
+void benchIntersect(void* context, int iterations) {
+    TrainSetFixture* f = (TrainSetFixture*)context;
+    long long total = 0;
+    for (int i = 0; i < iterations; i++) {
+        total += intersectTrainSets(f->a, f->b, f->out);
+        f->a.words[i % TRAIN_SET_WORDS] ^= total;  // keep iterations dependent
+    }
+    sink = total;
+}
+
+// Adds and releases a train named M<stations> running S00 .. S<stations-1>
+Train* addBenchTrain(TrainManager* trains, int stationNum) {
+    char id[16], stations[MAX_STATIONS * 4], prices[MAX_STATIONS * 4];
+    char travel[MAX_STATIONS * 4], stopover[MAX_STATIONS * 4];
+    char* sp = stations; char* pp = prices; char* tp = travel; char* op = stopover;
+    sprintf(id, "M%d", stationNum);
+    for (int i = 0; i < stationNum; i++) {
+        sp += sprintf(sp, i ? "|S%02d" : "S%02d", i);
+        if (i + 1 < stationNum) {
+            pp += sprintf(pp, i ? "|%d" : "%d", 10 + i);
+            tp += sprintf(tp, i ? "|%d" : "%d", 30);
+        }
+        if (i > 0 && i + 1 < stationNum) op += sprintf(op, i > 1 ? "|%d" : "%d", 5);
+    }
+    if (stationNum == 2) strcpy(stopover, "_");
+
+    trains->addTrain(id, stationNum, 100000, stations, prices, "08:00", travel, stopover, "06-01|08-31", 'G');
+    trains->releaseTrain(id);
+    return trains->findTrain(id);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) nameFilter = argv[1];
+
+    printf("%-24s %6s %10s %10s %10s %10s %8s %10s\n", "case", "size", "iters", "min_ns", "median_ns",
+           "mean_ns", "stddev", "cycles");
+
+    // UserManager::findUser over 10, 100 and 1000 stored users
+    static const int USER_SIZES[] = {10, 100, 1000};
+    for (int s = 0; s < 3; s++) {
+        UserFixture* f = new UserFixture();
+        f->users = new UserManager();
+        f->count = USER_SIZES[s];
+        for (int i = 0; i < f->count; i++) {
+            sprintf(f->names[i], "user%d", i);
+            f->users->addUser(f->names[0], f->names[i], "password", "乘客", "mail@ticket.cn", i == 0 ? 10 : 1);
+            if (i == 0) f->users->login(f->names[0], "password");
+        }
+        runCase("findUser", f->count, benchFindUser, f);
+        delete f->users;
+        delete f;
+    }
+
+    // Station lookups, prices and seats on trains of 2, 10 and 100 stations
+    TrainManager* trains = new TrainManager();
+    TrainFixture trainFixtures[SIZE_COUNT];
+    for (int s = 0; s < SIZE_COUNT; s++) {
+        TrainFixture& f = trainFixtures[s];
+        f.trains = trains;
+        f.train = addBenchTrain(trains, SIZES[s]);
+        for (int i = 0; i < SIZES[s]; i++) sprintf(f.stations[i], "S%02d", i);
+    }
+    for (int s = 0; s < SIZE_COUNT; s++) runCase("getStationIndex", SIZES[s], benchStationIndex, &trainFixtures[s]);
+    for (int s = 0; s < SIZE_COUNT; s++) runCase("calculatePrice", SIZES[s], benchCalculatePrice, &trainFixtures[s]);
+    for (int s = 0; s < SIZE_COUNT; s++) runCase("getMinAvailableSeats", SIZES[s], benchMinSeats, &trainFixtures[s]);
+    for (int s = 0; s < SIZE_COUNT; s++) runCase("updateSeats", SIZES[s], benchUpdateSeats, &trainFixtures[s]);
+
+    // Station bitset intersection over every train slot
+    TrainSetFixture sets;
+    for (int i = 0; i < TRAIN_SET_WORDS; i++) {
+        sets.a.words[i] = 0x9E3779B97F4A7C15ULL * (i + 1);
+        sets.b.words[i] = 0xC2B2AE3D27D4EB4FULL * (i + 1);
+    }
+    if (!nameFilter || strstr("intersectTrainSets", nameFilter)) {
+        printf("# intersectTrainSets kernel: %s\n", trainSetKernel());
+    }
+    runCase("intersectTrainSets", TRAIN_SET_WORDS * 64, benchIntersect, &sets);
+
+    runCase("parseDate", 1, benchParseDate, nullptr);
+    runCase("parseTime", 1, benchParseTime, nullptr);
+
+    // TicketSystem::parseArgs with 2, 6 and 10 key/value pairs
+    static const int ARG_COUNTS[] = {2, 6, 10};
+    static const char* const ARG_PAIRS[] = {
+        "-u user1", "-p password1", "-c root", "-n 乘客", "-m user1@ticket.cn", "-g 3",
+        "-i G1234", "-d 07-15", "-f 上海", "-t 北京"
+    };
+    for (int s = 0; s < 3; s++) {
+        ArgsFixture f;
+        char* ptr = f.args;
+        for (int i = 0; i < ARG_COUNTS[s]; i++) ptr += sprintf(ptr, i ? " %s" : "%s", ARG_PAIRS[i]);
+        runCase("parseArgs", ARG_COUNTS[s], benchParseArgs, &f);
+    }
+
+    // OrderManager::queryOrder formatting 1, 10 and 100 orders
+    static const int ORDER_SIZES[] = {1, 10, 100};
+    OrderManager* orders = new OrderManager();
+    Train* route = trainFixtures[1].train;
+    for (int s = 0; s < 3; s++) {
+        OrderFixture f;
+        f.orders = orders;
+        sprintf(f.username, "buyer%d", ORDER_SIZES[s]);
+        for (int i = 0; i < ORDER_SIZES[s]; i++) {
+            int price;
+            orders->buyTicket(f.username, route->trainID, "07-01", 1, "S00", "S05", false, price, trains);
+        }
+        runCase("queryOrder", ORDER_SIZES[s], benchQueryOrder, &f);
+    }
+
+    delete orders;
+    delete trains;
+    return 0;
+}
@@ -1,14 +1,54 @@
 #include "order.h"
 #include "train.h"
+#include "trace.h"
+#include "arena.h"
 #include <cstring>
 #include <cstdio>
 #include <time.h>
 
-OrderManager::OrderManager() : orderCount(0), nextOrderId(1) {}
+OrderManager::OrderManager() : segmentCount(0), tailCount(0), orderCount(0), nextOrderId(1) {
+    for (int i = 0; i < MAX_ORDER_SEGMENTS; i++) segments[i] = nullptr;
+}
+
+OrderManager::~OrderManager() {
+    clean();
+}
+
+void OrderManager::sealTail() {
+    OrderSegment* segment = new OrderSegment();
+    segment->seal(tail, tailCount);
+    segments[segmentCount++] = segment;
+    tailCount = 0;
+}
+
+int OrderManager::collectUserOrders(const char* username, int* positions) {
+    int count = 0;
+    for (int s = 0; s < segmentCount; s++) {
+        int found = segments[s]->findUser(username, positions + count);
+        for (int i = 0; i < found; i++) positions[count + i] += s * ORDER_SEGMENT_SIZE;
+        count += found;
+    }
+    for (int i = 0; i < tailCount; i++) {
+        if (strcmp(tail[i].username, username) == 0) {
+            positions[count++] = segmentCount * ORDER_SEGMENT_SIZE + i;
+        }
+    }
+    return count;
+}
+
+void OrderManager::readOrder(int position, Order& order) {
+    int segment = position / ORDER_SEGMENT_SIZE;
+    if (segment == segmentCount) {
+        order = tail[position % ORDER_SEGMENT_SIZE];
+    } else {
+        segments[segment]->decode(position % ORDER_SEGMENT_SIZE, order);
+    }
+}
 
 int OrderManager::buyTicket(const char* username, const char* trainID, const char* dateStr,
                            int numTickets, const char* fromStation, const char* toStation,
                            bool queueIfUnavailable, int& totalPrice, TrainManager* trainManager) {
+    TRACE_SCOPE("OrderManager::buyTicket");
     if (numTickets <= 0 || numTickets > 100000) return -1;
 
     // Find the train
@@ -28,9 +68,9 @@ int OrderManager::buyTicket(const char* username, const char* trainID, const cha
     int price = trainManager->calculatePrice(train, fromIndex, toIndex);
     totalPrice = price * numTickets;
 
-    // Check seat availability
-    int availableSeats = trainManager->getAvailableSeats(train, fromIndex, toIndex, queryDate);
-    if (availableSeats < numTickets) {
+    // Check and take the seats in one step; a separate availability read
+    // could be invalidated by a concurrent purchase on the same train
+    if (!trainManager->updateSeats(train, fromIndex, toIndex, numTickets, true)) {
         if (queueIfUnavailable) {
             // Add to queue (simplified - just return queue for now)
             return -2; // Special code for queue
@@ -39,15 +79,15 @@ int OrderManager::buyTicket(const char* username, const char* trainID, const cha
         }
     }
 
-    // Update seats
-    if (!trainManager->updateSeats(train, fromIndex, toIndex, numTickets, true)) {
+    // Create order
+    std::lock_guard<std::mutex> guard(orderLock);
+    if (orderCount >= MAX_ORDERS) {
+        trainManager->updateSeats(train, fromIndex, toIndex, numTickets, false);
         return -1;
     }
 
-    // Create order
-    if (orderCount >= MAX_ORDERS) return -1;
-
-    Order& newOrder = orders[orderCount++];
+    orderCount++;
+    Order& newOrder = tail[tailCount++];
     newOrder.id = nextOrderId++;
     strcpy(newOrder.username, username);
     strcpy(newOrder.trainID, trainID);
@@ -63,18 +103,18 @@ int OrderManager::buyTicket(const char* username, const char* trainID, const cha
     newOrder.departureTime = Time(0, 0); // Should be calculated properly
     newOrder.arrivalTime = Time(0, 0);   // Should be calculated properly
 
+    if (tailCount == ORDER_SEGMENT_SIZE) sealTail();
     return totalPrice;
 }
 
-int OrderManager::queryOrder(const char* username, char* result) {
-    // Count user's orders
-    int userOrderCount = 0;
-    for (int i = 0; i < orderCount; i++) {
-        if (strcmp(orders[i].username, username) == 0) {
-            userOrderCount++;
-        }
-    }
+int OrderManager::queryOrder(const char* username, char*& result) {
+    TRACE_SCOPE("OrderManager::queryOrder");
+    Arena& arena = Arena::current();
+    int* positions = arena.allocateArray<int>(orderCount);
+    int userOrderCount = collectUserOrders(username, positions);
 
+    // An order line is well under 128 bytes
+    result = arena.allocateArray<char>(16 + userOrderCount * 128);
     if (userOrderCount == 0) {
         strcpy(result, "0");
         return 0;
@@ -83,52 +123,90 @@ int OrderManager::queryOrder(const char* username, char* result) {
     char* ptr = result;
     ptr += sprintf(ptr, "%d\n", userOrderCount);
 
-    // Output orders in reverse order (newest first)
-    for (int i = orderCount - 1; i >= 0; i--) {
-        if (strcmp(orders[i].username, username) == 0) {
-            const char* statusStr = "";
-            switch (orders[i].status) {
-                case ORDER_SUCCESS: statusStr = "success"; break;
-                case ORDER_PENDING: statusStr = "pending"; break;
-                case ORDER_REFUNDED: statusStr = "refunded"; break;
-            }
-
-            ptr += sprintf(ptr, "[%s] %s %s %02d-%02d %02d:%02d -> %s %02d-%02d %02d:%02d %d %d\n",
-                          statusStr, orders[i].trainID, orders[i].fromStation,
-                          orders[i].departureDate.month, orders[i].departureDate.day,
-                          orders[i].departureTime.hour, orders[i].departureTime.minute,
-                          orders[i].toStation, orders[i].departureDate.month,
-                          orders[i].departureDate.day, orders[i].arrivalTime.hour,
-                          orders[i].arrivalTime.minute, orders[i].price, orders[i].numTickets);
+    // Output orders in reverse order (newest first), decoding only these
+    for (int k = userOrderCount - 1; k >= 0; k--) {
+        Order order;
+        readOrder(positions[k], order);
+
+        const char* statusStr = "";
+        switch (order.status) {
+            case ORDER_SUCCESS: statusStr = "success"; break;
+            case ORDER_PENDING: statusStr = "pending"; break;
+            case ORDER_REFUNDED: statusStr = "refunded"; break;
         }
+
+        ptr += sprintf(ptr, "[%s] %s %s %02d-%02d %02d:%02d -> %s %02d-%02d %02d:%02d %d %d\n",
+                      statusStr, order.trainID, order.fromStation,
+                      order.departureDate.month, order.departureDate.day,
+                      order.departureTime.hour, order.departureTime.minute,
+                      order.toStation, order.departureDate.month,
+                      order.departureDate.day, order.arrivalTime.hour,
+                      order.arrivalTime.minute, order.price, order.numTickets);
     }
 
     return 0;
 }
 
 int OrderManager::refundTicket(const char* username, int orderIndex) {
+    TRACE_SCOPE("OrderManager::refundTicket");
     // Find user's orders
-    int userOrderIndices[MAX_ORDERS];
-    int userOrderCount = 0;
-
-    for (int i = 0; i < orderCount; i++) {
-        if (strcmp(orders[i].username, username) == 0) {
-            userOrderIndices[userOrderCount++] = i;
-        }
-    }
+    ArenaScope scope;
+    int* positions = Arena::current().allocateArray<int>(orderCount);
+    int userOrderCount = collectUserOrders(username, positions);
 
     if (orderIndex < 1 || orderIndex > userOrderCount) return -1;
 
-    int actualIndex = userOrderIndices[userOrderCount - orderIndex];
-    Order& order = orders[actualIndex];
-
-    if (order.status != ORDER_SUCCESS) return -1;
-
-    order.status = ORDER_REFUNDED;
+    // Status is the one mutable field, in place in the tail or the
+    // segment's status column
+    int position = positions[userOrderCount - orderIndex];
+    int segment = position / ORDER_SEGMENT_SIZE;
+    int index = position % ORDER_SEGMENT_SIZE;
+    if (segment == segmentCount) {
+        if (tail[index].status != ORDER_SUCCESS) return -1;
+        tail[index].status = ORDER_REFUNDED;
+    } else {
+        if (segments[segment]->getStatus(index) != ORDER_SUCCESS) return -1;
+        segments[segment]->setStatus(index, ORDER_REFUNDED);
+    }
     return 0;
 }
 
 void OrderManager::clean() {
+    // At most MAX_ORDER_SEGMENTS frees, whatever the order count
+    for (int i = 0; i < segmentCount; i++) {
+        delete segments[i];
+        segments[i] = nullptr;
+    }
+    segmentCount = 0;
+    tailCount = 0;
     orderCount = 0;
     nextOrderId = 1;
-}
\ No newline at end of file
+}
+
+bool OrderManager::save(RingFile& file) {
+    // Sealed segments go out in their compressed form
+    if (!file.write(&nextOrderId, sizeof(nextOrderId)) ||
+        !file.write(&segmentCount, sizeof(segmentCount))) return false;
+    for (int i = 0; i < segmentCount; i++) {
+        if (!segments[i]->save(file)) return false;
+    }
+    return file.write(&tailCount, sizeof(tailCount)) &&
+           file.write(tail, (long long)sizeof(Order) * tailCount);
+}
+
+bool OrderManager::load(RingFile& file) {
+    clean();
+    int count;
+    if (!file.read(&nextOrderId, sizeof(nextOrderId)) ||
+        !file.read(&count, sizeof(count)) || count < 0 || count > MAX_ORDER_SEGMENTS) return false;
+    for (int i = 0; i < count; i++) {
+        segments[segmentCount++] = new OrderSegment();
+        if (!segments[i]->load(file)) return false;
+        orderCount += segments[i]->size();
+    }
+    if (!file.read(&tailCount, sizeof(tailCount)) || tailCount < 0 || tailCount >= ORDER_SEGMENT_SIZE ||
+        !file.read(tail, (long long)sizeof(Order) * tailCount)) return false;
+
+    orderCount += tailCount;
+    return orderCount <= MAX_ORDERS;
+}
@@ -3,6 +3,8 @@
 
 #include "utils.h"
 #include "user.h"
+#include "order_log.h"
+#include <mutex>
 
 class TrainManager; // Forward declaration
 
@@ -34,26 +36,46 @@ struct Order {
     }
 };
 
+const int MAX_ORDER_SEGMENTS = MAX_ORDERS / ORDER_SEGMENT_SIZE + 1;
+
 class OrderManager {
 private:
-    Order orders[MAX_ORDERS];
+    // Orders in arrival order. The oldest live in sealed, compressed
+    // segments; the newest ORDER_SEGMENT_SIZE or fewer stay plain records
+    // in tail until it fills and is sealed. A position p names order p:
+    // segment p / ORDER_SEGMENT_SIZE, or the tail once past the segments.
+    OrderSegment* segments[MAX_ORDER_SEGMENTS];
+    int segmentCount;
+    Order tail[ORDER_SEGMENT_SIZE];
+    int tailCount;
     int orderCount;
     int nextOrderId;
+    std::mutex orderLock;  // guards order slot allocation
+
+    void sealTail();
+    // Positions of username's orders, oldest first; returns the count
+    int collectUserOrders(const char* username, int* positions);
+    void readOrder(int position, Order& order);
 
 public:
     OrderManager();
+    ~OrderManager();
 
     int buyTicket(const char* username, const char* trainID, const char* date,
                   int numTickets, const char* fromStation, const char* toStation,
                   bool queueIfUnavailable, int& totalPrice, TrainManager* trainManager);
-    int queryOrder(const char* username, char* result);
+    // result is allocated in the current command arena
+    int queryOrder(const char* username, char*& result);
     int refundTicket(const char* username, int orderIndex);
 
     void processPendingOrders(TrainManager* trainManager);
-    Order* getUserOrders(const char* username, int& count);
     bool canRefundOrder(const char* username, int orderIndex);
 
     void clean();
+
+    // Snapshot support: raw records, indexes are rebuilt on load
+    bool save(RingFile& file);
+    bool load(RingFile& file);
 };
 
 #endif // ORDER_H
\ No newline at end of file
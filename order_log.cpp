@@ -0,0 +1,276 @@
+#include "order_log.h"
+#include "order.h"
+#include "arena.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+int putVarint(unsigned char* out, unsigned long long value) {
+    int n = 0;
+    while (value >= 0x80) {
+        out[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (unsigned char)value;
+    return n;
+}
+
+unsigned long long getVarint(const unsigned char*& in) {
+    unsigned long long value = 0;
+    int shift = 0;
+    while (*in & 0x80) {
+        value |= (unsigned long long)(*in++ & 0x7F) << shift;
+        shift += 7;
+    }
+    return value | (unsigned long long)*in++ << shift;
+}
+
+unsigned long long zigzag(long long value) {
+    return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+long long unzigzag(unsigned long long value) {
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+int compareStrings(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+// Length-prefixed array of count elements of the given size
+bool saveArray(RingFile& file, const void* data, int count, int elementSize) {
+    return file.write(&count, sizeof(count)) && file.write(data, (long long)count * elementSize);
+}
+
+} // namespace
+
+VarintColumn::~VarintColumn() {
+    delete[] bytes;
+    delete[] restarts;
+}
+
+void VarintColumn::encode(const long long* values, int n, bool isDelta) {
+    delete[] bytes;
+    delete[] restarts;
+    count = n;
+    delta = isDelta;
+    restarts = new int[(n + ORDER_RESTART_INTERVAL - 1) / ORDER_RESTART_INTERVAL + 1];
+
+    ArenaScope scope;
+    unsigned char* buffer = Arena::current().allocateArray<unsigned char>(n * 10 + 1);
+    length = 0;
+    long long previous = 0;
+    for (int i = 0; i < n; i++) {
+        if (i % ORDER_RESTART_INTERVAL == 0) {
+            restarts[i / ORDER_RESTART_INTERVAL] = length;
+            previous = 0;
+        }
+        unsigned long long encoded = delta ? zigzag(values[i] - previous) : (unsigned long long)values[i];
+        previous = values[i];
+        length += putVarint(buffer + length, encoded);
+    }
+
+    bytes = new unsigned char[length > 0 ? length : 1];
+    memcpy(bytes, buffer, length);
+}
+
+long long VarintColumn::get(int index) const {
+    int group = index / ORDER_RESTART_INTERVAL;
+    const unsigned char* p = bytes + restarts[group];
+    long long value = 0;
+    for (int i = group * ORDER_RESTART_INTERVAL; i <= index; i++) {
+        unsigned long long encoded = getVarint(p);
+        value = delta ? value + unzigzag(encoded) : (long long)encoded;
+    }
+    return value;
+}
+
+void VarintColumn::decodeRange(int begin, int end, long long* out) const {
+    if (begin >= end) return;
+    int first = begin - begin % ORDER_RESTART_INTERVAL;
+    const unsigned char* p = bytes + restarts[first / ORDER_RESTART_INTERVAL];
+    long long value = 0;
+    for (int i = first; i < end; i++) {
+        if (i % ORDER_RESTART_INTERVAL == 0) value = 0;
+        unsigned long long encoded = getVarint(p);
+        value = delta ? value + unzigzag(encoded) : (long long)encoded;
+        if (i >= begin) out[i - begin] = value;
+    }
+}
+
+long long VarintColumn::memoryBytes() const {
+    return length + (long long)sizeof(int) * ((count + ORDER_RESTART_INTERVAL - 1) / ORDER_RESTART_INTERVAL);
+}
+
+bool VarintColumn::save(RingFile& file) const {
+    int restartCount = (count + ORDER_RESTART_INTERVAL - 1) / ORDER_RESTART_INTERVAL;
+    return file.write(&count, sizeof(count)) &&
+           file.write(&delta, sizeof(delta)) &&
+           saveArray(file, bytes, length, 1) &&
+           file.write(restarts, (long long)sizeof(int) * restartCount);
+}
+
+bool VarintColumn::load(RingFile& file) {
+    delete[] bytes;
+    delete[] restarts;
+    bytes = nullptr;
+    restarts = nullptr;
+    if (!file.read(&count, sizeof(count)) || count < 0 || count > ORDER_SEGMENT_SIZE ||
+        !file.read(&delta, sizeof(delta)) ||
+        !file.read(&length, sizeof(length)) || length < 0 || length > count * 10) return false;
+
+    int restartCount = (count + ORDER_RESTART_INTERVAL - 1) / ORDER_RESTART_INTERVAL;
+    bytes = new unsigned char[length > 0 ? length : 1];
+    restarts = new int[restartCount + 1];
+    return file.read(bytes, length) && file.read(restarts, (long long)sizeof(int) * restartCount);
+}
+
+void StringDictionary::build(const char* strings, int stride, int n, int entryWidth, long long* codes) {
+    ArenaScope scope;
+    const char** sorted = Arena::current().allocateArray<const char*>(n);
+    for (int i = 0; i < n; i++) sorted[i] = strings + (long long)i * stride;
+    qsort(sorted, n, sizeof(const char*), compareStrings);
+
+    delete[] entries;
+    width = entryWidth;
+    entries = new char[(long long)(n > 0 ? n : 1) * width];
+    count = 0;
+    for (int i = 0; i < n; i++) {
+        if (count > 0 && strcmp(at(count - 1), sorted[i]) == 0) continue;
+        strncpy(entries + (long long)count * width, sorted[i], width - 1);
+        entries[(long long)count * width + width - 1] = '\0';
+        count++;
+    }
+
+    for (int i = 0; i < n; i++) codes[i] = find(strings + (long long)i * stride);
+}
+
+int StringDictionary::find(const char* key) const {
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(at(mid), key);
+        if (cmp == 0) return mid;
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return -1;
+}
+
+bool StringDictionary::save(RingFile& file) const {
+    return file.write(&width, sizeof(width)) && saveArray(file, entries, count, width);
+}
+
+bool StringDictionary::load(RingFile& file) {
+    delete[] entries;
+    entries = nullptr;
+    if (!file.read(&width, sizeof(width)) || width <= 0 || width > 64 ||
+        !file.read(&count, sizeof(count)) || count < 0 || count > ORDER_SEGMENT_SIZE * 2) return false;
+    entries = new char[(long long)(count > 0 ? count : 1) * width];
+    return file.read(entries, (long long)count * width);
+}
+
+void OrderSegment::seal(const Order* orders, int n) {
+    count = n;
+    ArenaScope scope;
+    Arena& arena = Arena::current();
+    long long* values = arena.allocateArray<long long>(n);
+
+    for (int i = 0; i < n; i++) values[i] = orders[i].id;
+    ids.encode(values, n, true);
+    for (int i = 0; i < n; i++) values[i] = orders[i].timestamp;
+    timestamps.encode(values, n, true);
+    for (int i = 0; i < n; i++) values[i] = orders[i].price;
+    prices.encode(values, n, false);
+    for (int i = 0; i < n; i++) values[i] = orders[i].numTickets;
+    tickets.encode(values, n, false);
+    for (int i = 0; i < n; i++) values[i] = dateToDay(orders[i].departureDate);
+    days.encode(values, n, false);
+    for (int i = 0; i < n; i++) values[i] = orders[i].departureTime.hour * 60 + orders[i].departureTime.minute;
+    departures.encode(values, n, false);
+    for (int i = 0; i < n; i++) values[i] = orders[i].arrivalTime.hour * 60 + orders[i].arrivalTime.minute;
+    arrivals.encode(values, n, false);
+
+    users.build(orders[0].username, sizeof(Order), n, sizeof(orders[0].username), values);
+    userCodes.encode(values, n, false);
+    trains.build(orders[0].trainID, sizeof(Order), n, sizeof(orders[0].trainID), values);
+    trainCodes.encode(values, n, false);
+
+    // From and to stations share one dictionary
+    const int stationWidth = sizeof(orders[0].fromStation);
+    char* names = arena.allocateArray<char>(n * 2 * stationWidth);
+    for (int i = 0; i < n; i++) {
+        strcpy(names + (long long)i * stationWidth, orders[i].fromStation);
+        strcpy(names + (long long)(n + i) * stationWidth, orders[i].toStation);
+    }
+    long long* stationCodes = arena.allocateArray<long long>(n * 2);
+    stations.build(names, stationWidth, n * 2, stationWidth, stationCodes);
+    fromCodes.encode(stationCodes, n, false);
+    toCodes.encode(stationCodes + n, n, false);
+
+    delete[] status;
+    status = new unsigned char[n > 0 ? n : 1];
+    for (int i = 0; i < n; i++) status[i] = (unsigned char)orders[i].status;
+}
+
+int OrderSegment::findUser(const char* username, int* positions) const {
+    // Most segments never saw this user: one dictionary probe skips them
+    int code = users.find(username);
+    if (code == -1) return 0;
+
+    long long codes[ORDER_SEGMENT_SIZE];
+    userCodes.decodeRange(0, count, codes);
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        if (codes[i] == code) positions[found++] = i;
+    }
+    return found;
+}
+
+void OrderSegment::decode(int index, Order& order) const {
+    order.id = (int)ids.get(index);
+    order.timestamp = timestamps.get(index);
+    order.price = (int)prices.get(index);
+    order.numTickets = (int)tickets.get(index);
+    order.departureDate = dayToDate((int)days.get(index));
+    int departure = (int)departures.get(index);
+    order.departureTime = Time(departure / 60, departure % 60);
+    int arrival = (int)arrivals.get(index);
+    order.arrivalTime = Time(arrival / 60, arrival % 60);
+    strcpy(order.username, users.at((int)userCodes.get(index)));
+    strcpy(order.trainID, trains.at((int)trainCodes.get(index)));
+    strcpy(order.fromStation, stations.at((int)fromCodes.get(index)));
+    strcpy(order.toStation, stations.at((int)toCodes.get(index)));
+    order.status = (OrderStatus)status[index];
+}
+
+long long OrderSegment::memoryBytes() const {
+    return ids.memoryBytes() + timestamps.memoryBytes() + prices.memoryBytes() + tickets.memoryBytes() +
+           days.memoryBytes() + departures.memoryBytes() + arrivals.memoryBytes() +
+           userCodes.memoryBytes() + trainCodes.memoryBytes() + fromCodes.memoryBytes() + toCodes.memoryBytes() +
+           users.memoryBytes() + trains.memoryBytes() + stations.memoryBytes() + count;
+}
+
+bool OrderSegment::save(RingFile& file) const {
+    return file.write(&count, sizeof(count)) &&
+           ids.save(file) && timestamps.save(file) && prices.save(file) && tickets.save(file) &&
+           days.save(file) && departures.save(file) && arrivals.save(file) &&
+           userCodes.save(file) && trainCodes.save(file) && fromCodes.save(file) && toCodes.save(file) &&
+           users.save(file) && trains.save(file) && stations.save(file) &&
+           file.write(status, count);
+}
+
+bool OrderSegment::load(RingFile& file) {
+    if (!file.read(&count, sizeof(count)) || count < 0 || count > ORDER_SEGMENT_SIZE) return false;
+    delete[] status;
+    status = new unsigned char[count > 0 ? count : 1];
+    return ids.load(file) && timestamps.load(file) && prices.load(file) && tickets.load(file) &&
+           days.load(file) && departures.load(file) && arrivals.load(file) &&
+           userCodes.load(file) && trainCodes.load(file) && fromCodes.load(file) && toCodes.load(file) &&
+           users.load(file) && trains.load(file) && stations.load(file) &&
+           file.read(status, count);
+}
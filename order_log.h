@@ -0,0 +1,101 @@
+#ifndef ORDER_LOG_H
+#define ORDER_LOG_H
+
+#include "utils.h"
+#include "ring_file.h"
+
+struct Order;
+
+// Orders per sealed segment, and how often each column restarts its
+// encoding. Any single value decodes from at most ORDER_RESTART_INTERVAL
+// varints.
+const int ORDER_SEGMENT_SIZE = 1024;
+const int ORDER_RESTART_INTERVAL = 16;
+
+// Varint-encoded integer column. Delta columns store zigzagged differences
+// from the previous value and restart from zero at every restart point.
+class VarintColumn {
+private:
+    unsigned char* bytes;
+    int length;
+    int* restarts;  // byte offset of every ORDER_RESTART_INTERVAL-th value
+    int count;
+    bool delta;
+
+    VarintColumn(const VarintColumn&);
+    VarintColumn& operator=(const VarintColumn&);
+
+public:
+    VarintColumn() : bytes(nullptr), length(0), restarts(nullptr), count(0), delta(false) {}
+    ~VarintColumn();
+
+    void encode(const long long* values, int n, bool isDelta);
+    long long get(int index) const;
+    // Decodes values [begin, end) into out
+    void decodeRange(int begin, int end, long long* out) const;
+
+    long long memoryBytes() const;
+    bool save(RingFile& file) const;
+    bool load(RingFile& file);
+};
+
+// Sorted table of distinct fixed-width strings; codes are table positions
+class StringDictionary {
+private:
+    char* entries;
+    int width;
+    int count;
+
+    StringDictionary(const StringDictionary&);
+    StringDictionary& operator=(const StringDictionary&);
+
+public:
+    StringDictionary() : entries(nullptr), width(0), count(0) {}
+    ~StringDictionary() { delete[] entries; }
+
+    // Builds the dictionary for n strings of at most width - 1 bytes
+    // (stride apart in memory) and stores each one's code in codes
+    void build(const char* strings, int stride, int n, int entryWidth, long long* codes);
+    int find(const char* key) const;  // -1 if absent
+    const char* at(int code) const { return entries + (long long)code * width; }
+
+    long long memoryBytes() const { return (long long)count * width; }
+    bool save(RingFile& file) const;
+    bool load(RingFile& file);
+};
+
+// A sealed, immutable run of ORDER_SEGMENT_SIZE orders stored by column:
+// delta-coded ids and timestamps, varint prices, counts, dates and times,
+// and per-segment dictionaries for usernames, trainIDs and stations. The
+// status column stays one plain byte per order so refunds update it in
+// place.
+class OrderSegment {
+private:
+    int count;
+    VarintColumn ids, timestamps, prices, tickets, days, departures, arrivals;
+    VarintColumn userCodes, trainCodes, fromCodes, toCodes;
+    StringDictionary users, trains, stations;
+    unsigned char* status;
+
+    OrderSegment(const OrderSegment&);
+    OrderSegment& operator=(const OrderSegment&);
+
+public:
+    OrderSegment() : count(0), status(nullptr) {}
+    ~OrderSegment() { delete[] status; }
+
+    void seal(const Order* orders, int n);
+
+    int size() const { return count; }
+    // Appends the in-segment positions of username's orders, oldest first
+    int findUser(const char* username, int* positions) const;
+    void decode(int index, Order& order) const;
+    int getStatus(int index) const { return status[index]; }
+    void setStatus(int index, int value) { status[index] = (unsigned char)value; }
+
+    long long memoryBytes() const;
+    bool save(RingFile& file) const;
+    bool load(RingFile& file);
+};
+
+#endif // ORDER_LOG_H
@@ -0,0 +1,166 @@
+#include "pair_index.h"
+#include <cstring>
+
+PairIndex::PairIndex() : root(nullptr), nodeCount(0), entryCount(0) {
+    for (int kind = 0; kind < 2; kind++) {
+        lists[kind].live = lists[kind].liveTail = lists[kind].spare = nullptr;
+    }
+}
+
+PairIndex::~PairIndex() {
+    clear();
+    for (int kind = 0; kind < 2; kind++) {
+        for (Node* node = lists[kind].spare; node;) {
+            Node* next = node->chain;
+            if (kind) {
+                delete (Leaf*)node;
+            } else {
+                delete (Inner*)node;
+            }
+            node = next;
+        }
+    }
+}
+
+PairIndex::Node* PairIndex::takeNode(bool leaf) {
+    NodeList& list = lists[leaf];
+    Node* node = list.spare;
+    if (node) {
+        list.spare = node->chain;
+    } else {
+        node = leaf ? (Node*)new Leaf() : (Node*)new Inner();
+        nodeCount++;
+    }
+    node->leaf = leaf;
+    node->count = 0;
+    node->chain = list.live;
+    if (!list.live) list.liveTail = node;
+    list.live = node;
+    return node;
+}
+
+unsigned long long PairIndex::packKey(int fromStation, int toStation, int serial) {
+    // 24 bits per station id, 16 for the serial
+    return ((unsigned long long)fromStation << 40) | ((unsigned long long)toStation << 16) | serial;
+}
+
+void PairIndex::insert(int fromStation, int toStation, const Entry& entry) {
+    unsigned long long key = packKey(fromStation, toStation, entry.serial);
+    if (!root) {
+        Leaf* leaf = (Leaf*)takeNode(true);
+        leaf->next = nullptr;
+        root = leaf;
+    }
+
+    unsigned long long splitKey;
+    Node* right = insertInto(root, key, entry, splitKey);
+    if (right) {
+        // The root split: grow the tree by one level
+        Inner* top = (Inner*)takeNode(false);
+        top->count = 1;
+        top->keys[0] = splitKey;
+        top->children[0] = root;
+        top->children[1] = right;
+        root = top;
+    }
+    entryCount++;
+}
+
+PairIndex::Node* PairIndex::insertInto(Node* node, unsigned long long key, const Entry& entry,
+                                       unsigned long long& splitKey) {
+    if (node->leaf) {
+        Leaf* leaf = (Leaf*)node;
+        int pos = leaf->count;
+        while (pos > 0 && leaf->keys[pos - 1] > key) {
+            leaf->keys[pos] = leaf->keys[pos - 1];
+            leaf->entries[pos] = leaf->entries[pos - 1];
+            pos--;
+        }
+        leaf->keys[pos] = key;
+        leaf->entries[pos] = entry;
+        if (++leaf->count <= LEAF_CAPACITY) return nullptr;
+
+        Leaf* right = (Leaf*)takeNode(true);
+        int half = leaf->count / 2;
+        right->count = leaf->count - half;
+        memcpy(right->keys, leaf->keys + half, sizeof(unsigned long long) * right->count);
+        memcpy(right->entries, leaf->entries + half, sizeof(Entry) * right->count);
+        leaf->count = half;
+        right->next = leaf->next;
+        leaf->next = right;
+        splitKey = right->keys[0];
+        return right;
+    }
+
+    Inner* inner = (Inner*)node;
+    int child = 0;
+    while (child < inner->count && inner->keys[child] <= key) child++;
+    unsigned long long childSplit;
+    Node* grown = insertInto(inner->children[child], key, entry, childSplit);
+    if (!grown) return nullptr;
+
+    memmove(inner->keys + child + 1, inner->keys + child, sizeof(unsigned long long) * (inner->count - child));
+    memmove(inner->children + child + 2, inner->children + child + 1, sizeof(Node*) * (inner->count - child));
+    inner->keys[child] = childSplit;
+    inner->children[child + 1] = grown;
+    if (++inner->count <= INNER_CAPACITY) return nullptr;
+
+    // The middle key moves up; it separates the halves
+    Inner* right = (Inner*)takeNode(false);
+    int mid = inner->count / 2;
+    right->count = inner->count - mid - 1;
+    memcpy(right->keys, inner->keys + mid + 1, sizeof(unsigned long long) * right->count);
+    memcpy(right->children, inner->children + mid + 1, sizeof(Node*) * (right->count + 1));
+    splitKey = inner->keys[mid];
+    inner->count = mid;
+    return right;
+}
+
+int PairIndex::collect(int fromStation, int toStation, Entry* out) const {
+    if (!root) return 0;
+    unsigned long long low = packKey(fromStation, toStation, 0);
+    unsigned long long high = packKey(fromStation, toStation, 0xFFFF);
+
+    const Node* node = root;
+    while (!node->leaf) {
+        const Inner* inner = (const Inner*)node;
+        // Binary search for the child whose key range holds low
+        int lo = 0, hi = inner->count;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (inner->keys[mid] <= low) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        node = inner->children[lo];
+    }
+
+    const Leaf* leaf = (const Leaf*)node;
+    int pos = 0;
+    while (pos < leaf->count && leaf->keys[pos] < low) pos++;
+    int n = 0;
+    while (leaf) {
+        for (; pos < leaf->count; pos++) {
+            if (leaf->keys[pos] > high) return n;
+            out[n++] = leaf->entries[pos];
+        }
+        leaf = leaf->next;
+        pos = 0;
+    }
+    return n;
+}
+
+void PairIndex::clear() {
+    // Splice each live list in front of its spare list
+    for (int kind = 0; kind < 2; kind++) {
+        NodeList& list = lists[kind];
+        if (!list.live) continue;
+        list.liveTail->chain = list.spare;
+        list.spare = list.live;
+        list.live = list.liveTail = nullptr;
+    }
+    root = nullptr;
+    entryCount = 0;
+}
@@ -0,0 +1,89 @@
+#ifndef PAIR_INDEX_H
+#define PAIR_INDEX_H
+
+#include "utils.h"
+
+// Materialized station pairs for query_ticket: a B+ tree keyed by
+// (fromStation, toStation, train serial) holding, for every ordered pair
+// of stops on every released train, the trip's price and minutes. A
+// query is then a single range scan over one (from, to) prefix.
+//
+// Nodes are PAGE_SIZE blocks, leaves chained left to right. Released
+// trains are never deleted, so the tree only grows until clear(). clear()
+// runs in constant time: it hands every node to a spare list in one step,
+// and later inserts take their nodes from there before allocating.
+// Entries name trains by their release serial, the index into TrainTable,
+// rather than by slot or rank: compaction moves slots and every release
+// shifts later ranks, while serials stay put.
+//
+// Only built with ENABLE_PAIR_INDEX; it holds sum(stationNum^2 / 2)
+// entries, which a 42 MiB process cannot afford.
+class PairIndex {
+public:
+    static const int PAGE_SIZE = 4096;
+
+    struct Entry {
+        int price;
+        int leaving;    // minutes from the origin's departure to leaving fromStation
+        int duration;   // minutes from leaving fromStation to arriving at toStation
+        unsigned char fromIndex, toIndex;
+        unsigned short serial;
+    };
+
+    PairIndex();
+    ~PairIndex();
+
+    void insert(int fromStation, int toStation, const Entry& entry);
+
+    // Copies the entries of one station pair into out, in serial order;
+    // there is at most one per released train. Returns the count.
+    int collect(int fromStation, int toStation, Entry* out) const;
+
+    long long memoryBytes() const { return (long long)nodeCount * PAGE_SIZE; }  // spare nodes included
+    long long size() const { return entryCount; }
+    void clear();
+
+private:
+    struct Node {
+        bool leaf;
+        int count;
+        Node* chain;  // next node of the same kind in its live or spare list
+    };
+
+    // Every node of one kind: live ones in the tree, spare ones for reuse
+    struct NodeList {
+        Node* live;
+        Node* liveTail;  // first node taken since the last clear
+        Node* spare;
+    };
+
+    // One slack slot each: a node overflows by one entry, then splits
+    static const int LEAF_CAPACITY = (PAGE_SIZE - 32) / (sizeof(unsigned long long) + sizeof(Entry)) - 1;
+    static const int INNER_CAPACITY = (PAGE_SIZE - 32) / (2 * sizeof(void*)) - 1;
+
+    struct Leaf : Node {
+        Leaf* next;
+        unsigned long long keys[LEAF_CAPACITY + 1];
+        Entry entries[LEAF_CAPACITY + 1];
+    };
+
+    struct Inner : Node {
+        unsigned long long keys[INNER_CAPACITY + 1];  // keys[i] is the first key under children[i + 1]
+        Node* children[INNER_CAPACITY + 2];
+    };
+
+    Node* root;
+    int nodeCount;          // allocated, live or spare
+    long long entryCount;
+    NodeList lists[2];      // indexed by Node::leaf
+
+    static unsigned long long packKey(int fromStation, int toStation, int serial);
+    // Inserts below node; returns the new right sibling if node split
+    Node* insertInto(Node* node, unsigned long long key, const Entry& entry, unsigned long long& splitKey);
+    Node* takeNode(bool leaf);  // a spare node if any, else a new one
+
+    PairIndex(const PairIndex&);
+    PairIndex& operator=(const PairIndex&);
+};
+
+#endif // PAIR_INDEX_H
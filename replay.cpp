@@ -0,0 +1,144 @@
+// Replays a capture written by `code --capture <file>` through TicketSystem
+// and diffs every reply byte for byte against the recorded one.
+//     ticket_replay <capture> [--checkpoint <file>]
+// A SESSION record after the first is a restart: the system is snapshotted
+// as on shutdown, destroyed and rebuilt from the checkpoint, and the time
+// this takes is reported next to per-command throughput and latency.
+// Sessions captured with --checkpoint replay through <capture>.ckpt
+// unless another file is given.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "ticket_system.h"
+#include "checkpoint.h"
+#include "capture.h"
+#include "stats.h"
+
+namespace {
+
+const int MAX_REPORTED_MISMATCHES = 10;
+
+// Prints at most one line of a reply, for mismatch reports
+void printExcerpt(const char* label, const char* data, int length) {
+    int end = 0;
+    while (end < length && end < 200 && data[end] != '\n') end++;
+    printf("  %s: %.*s%s\n", label, end, data, end < length - 1 ? " ..." : "");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <capture> [--checkpoint <file>]\n", argv[0]);
+        return 1;
+    }
+    const char* capturePath = argv[1];
+    char checkpointPath[256];
+    snprintf(checkpointPath, sizeof(checkpointPath), "%s.ckpt", capturePath);
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--checkpoint") == 0) {
+            snprintf(checkpointPath, sizeof(checkpointPath), "%s", argv[i + 1]);
+        }
+    }
+
+    CaptureReader reader;
+    if (!reader.open(capturePath)) {
+        fprintf(stderr, "%s: not a capture file\n", capturePath);
+        return 1;
+    }
+
+    TicketSystem* system = nullptr;
+    Checkpointer* checkpointer = nullptr;
+    OutputBuffer out;
+
+    long long commands = 0, mismatches = 0;
+    long long commandNanos[CommandStats::MAX_COMMANDS] = {0};
+    long long commandCounts[CommandStats::MAX_COMMANDS] = {0};
+    long long busyNanos = 0;
+    int sessions = 0;
+    long long restartNanos = 0;
+
+    int kind;
+    while ((kind = reader.next()) > 0) {
+        if (kind == CAPTURE_SESSION) {
+            long long start = CommandStats::nowNanos();
+            if (system && checkpointer) {
+                // Shut down as main does at end of input
+                checkpointer->wait();
+                checkpointer->start(*system);
+                checkpointer->wait();
+            }
+            delete checkpointer;
+            delete system;
+            checkpointer = nullptr;
+
+            system = new TicketSystem();
+            if (reader.flags() & CAPTURE_CHECKPOINTED) {
+                // The capture starts from an empty system
+                if (sessions == 0) unlink(checkpointPath);
+                checkpointer = new Checkpointer(checkpointPath);
+                checkpointer->load(*system);
+            }
+            if (sessions++ > 0) restartNanos += CommandStats::nowNanos() - start;
+            continue;
+        }
+
+        const char* command = reader.commandText();
+        if (!system) {
+            fprintf(stderr, "%s: command before the first session\n", capturePath);
+            return 1;
+        }
+
+        long long start = CommandStats::nowNanos();
+        system->processCommand(command, out);
+        if (checkpointer && !TicketSystem::isReadOnlyCommand(command)) {
+            checkpointer->noteCommand(*system, command);
+        }
+        long long elapsed = CommandStats::nowNanos() - start;
+
+        char name[32] = "";
+        sscanf(command, "%31s", name);
+        int type = CommandStats::commandIndex(name);
+        commandNanos[type] += elapsed;
+        commandCounts[type]++;
+        busyNanos += elapsed;
+        commands++;
+
+        const OutputBuffer& expected = reader.expectedReply();
+        if (out.size() != expected.size() || memcmp(out.data(), expected.data(), out.size()) != 0) {
+            if (mismatches++ < MAX_REPORTED_MISMATCHES) {
+                printf("mismatch at command %lld: %s\n", commands, command);
+                printExcerpt("expected", expected.data(), expected.size());
+                printExcerpt("actual", out.data(), out.size());
+            }
+        }
+        out.clear();
+    }
+    if (kind < 0) {
+        fprintf(stderr, "%s: corrupt record after command %lld\n", capturePath, commands);
+    }
+    if (checkpointer) checkpointer->wait();
+
+    printf("commands:         %lld\n", commands);
+    printf("mismatches:       %lld\n", mismatches);
+    printf("sessions:         %d\n", sessions);
+    if (sessions > 1) {
+        printf("restart avg:      %.3f ms\n", restartNanos / 1e6 / (sessions - 1));
+    }
+    printf("elapsed:          %.3f s\n", busyNanos * 1e-9);
+    printf("throughput:       %.0f commands/s\n", busyNanos > 0 ? commands / (busyNanos * 1e-9) : 0.0);
+
+    printf("command count total_ms commands_per_s\n");
+    for (int i = 0; i < CommandStats::MAX_COMMANDS; i++) {
+        if (commandCounts[i] == 0) continue;
+        printf("%s %lld %.3f %.0f\n", CommandStats::commandName(i), commandCounts[i], commandNanos[i] / 1e6,
+               commandNanos[i] > 0 ? commandCounts[i] / (commandNanos[i] * 1e-9) : 0.0);
+    }
+    CommandStats::instance().report(out);
+    fwrite(out.data(), 1, out.size(), stdout);
+
+    delete checkpointer;
+    delete system;
+    return mismatches == 0 && kind == 0 ? 0 : 2;
+}
@@ -0,0 +1,304 @@
+#include "ring_file.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+// user_data of the fsync entry; chunk entries carry their chunk index
+const int SYNC_TAG = RingFile::QUEUE_DEPTH;
+
+} // namespace
+
+RingFile::RingFile(int file)
+    : fd(file), nextOffset(0), fileSize(0), failed(false), reading(false), current(0),
+      ringFd(-1), sqRing(nullptr), cqRing(nullptr), sqRingSize(0), cqRingSize(0), sqes(nullptr), sqesSize(0),
+      pending(0), unsubmitted(0), syncResult(0) {
+    for (int i = 0; i < QUEUE_DEPTH; i++) {
+        chunks[i].data = new char[CHUNK_SIZE];
+        chunks[i].vector = new iovec();
+        chunks[i].length = chunks[i].consumed = 0;
+        chunks[i].offset = 0;
+        chunks[i].inFlight = false;
+        chunks[i].result = 0;
+    }
+    const char* setting = getenv("TICKET_IO_URING");
+    if (!setting || strcmp(setting, "0") != 0) setupRing();
+}
+
+RingFile::~RingFile() {
+    // The kernel may still be filling readahead chunks
+    submitQueued();
+    while (pending > 0 && reap(true)) {}
+    closeRing();
+    for (int i = 0; i < QUEUE_DEPTH; i++) {
+        delete[] chunks[i].data;
+        delete chunks[i].vector;
+    }
+}
+
+bool RingFile::setupRing() {
+#ifdef __NR_io_uring_setup
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring = syscall(__NR_io_uring_setup, QUEUE_DEPTH * 2, &params);
+    if (ring < 0) return false;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap) {
+        if (cqRingSize > sqRingSize) sqRingSize = cqRingSize;
+        cqRingSize = sqRingSize;
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+                  IORING_OFF_SQ_RING);
+    cqRing = singleMap ? sqRing
+                       : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+                              IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* entries = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+                         IORING_OFF_SQES);
+    ringFd = ring;
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || entries == MAP_FAILED) {
+        if (sqRing == MAP_FAILED) sqRing = nullptr;
+        if (cqRing == MAP_FAILED) cqRing = nullptr;
+        if (entries != MAP_FAILED) munmap(entries, sqesSize);
+        closeRing();
+        return false;
+    }
+    sqes = (io_uring_sqe*)entries;
+
+    char* sq = (char*)sqRing;
+    sqHead = (unsigned*)(sq + params.sq_off.head);
+    sqTail = (unsigned*)(sq + params.sq_off.tail);
+    sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    sqArray = (unsigned*)(sq + params.sq_off.array);
+    char* cq = (char*)cqRing;
+    cqHead = (unsigned*)(cq + params.cq_off.head);
+    cqTail = (unsigned*)(cq + params.cq_off.tail);
+    cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void RingFile::closeRing() {
+    if (ringFd == -1) return;
+    if (sqes) munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing) munmap(sqRing, sqRingSize);
+    close(ringFd);
+    ringFd = -1;
+    sqRing = cqRing = nullptr;
+    sqes = nullptr;
+}
+
+void RingFile::prepare(unsigned char opcode, int chunk, unsigned char flags) {
+    // The queue holds twice QUEUE_DEPTH entries, more than can be in flight
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->flags = flags;
+    sqe->fd = fd;
+    sqe->user_data = chunk;
+    if (chunk != SYNC_TAG) {
+        chunks[chunk].vector->iov_base = chunks[chunk].data;
+        chunks[chunk].vector->iov_len = chunks[chunk].length;
+        sqe->addr = (unsigned long long)chunks[chunk].vector;
+        sqe->len = 1;
+        sqe->off = chunks[chunk].offset;
+    }
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    unsubmitted++;
+    pending++;
+}
+
+void RingFile::submitQueued() {
+    if (ringFd == -1 || unsubmitted == 0) return;
+    int submitted;
+    do {
+        submitted = syscall(__NR_io_uring_enter, ringFd, unsubmitted, 0, 0, nullptr, 0);
+    } while (submitted < 0 && errno == EINTR);
+    if (submitted >= 0) unsubmitted -= submitted;
+}
+
+bool RingFile::reap(bool wait) {
+    if (ringFd == -1) return false;
+    unsigned head = *cqHead;
+    if (wait && head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+        int entered;
+        do {
+            entered = syscall(__NR_io_uring_enter, ringFd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        } while (entered < 0 && errno == EINTR);
+        if (entered < 0) return false;
+        unsubmitted -= entered;
+    }
+
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        io_uring_cqe* cqe = &cqes[head & *cqMask];
+        int tag = (int)cqe->user_data;
+        int result = cqe->res;
+        head++;
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        pending--;
+        if (tag == SYNC_TAG) {
+            syncResult = result;
+        } else {
+            complete(tag, result);
+        }
+    }
+    return true;
+}
+
+void RingFile::complete(int chunk, int result) {
+    Chunk& c = chunks[chunk];
+    c.inFlight = false;
+    // Short transfers and rejected opcodes finish synchronously
+    c.result = result;
+    if (result < c.length && !transferRest(c, result > 0 ? result : 0)) failed = true;
+}
+
+bool RingFile::transferRest(Chunk& chunk, int done) {
+    while (done < chunk.length) {
+        ssize_t n = reading ? pread(fd, chunk.data + done, chunk.length - done, chunk.offset + done)
+                            : pwrite(fd, chunk.data + done, chunk.length - done, chunk.offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += n;
+    }
+    chunk.result = done;
+    return true;
+}
+
+void RingFile::queueWrite(int chunk) {
+    Chunk& c = chunks[chunk];
+    c.offset = nextOffset;
+    nextOffset += c.length;
+    if (ringFd != -1) {
+        c.inFlight = true;
+        prepare(IORING_OP_WRITEV, chunk, 0);
+    } else if (!transferRest(c, 0)) {
+        failed = true;
+    }
+}
+
+void RingFile::queueRead(int chunk) {
+    Chunk& c = chunks[chunk];
+    c.consumed = 0;
+    c.offset = nextOffset;
+    long long left = fileSize - nextOffset;
+    c.length = left < CHUNK_SIZE ? (int)left : CHUNK_SIZE;
+    nextOffset += c.length;
+    if (c.length == 0) return;  // past the end: an empty chunk reads as EOF
+    if (ringFd != -1) {
+        c.inFlight = true;
+        prepare(IORING_OP_READV, chunk, 0);
+    } else if (!transferRest(c, 0)) {
+        failed = true;
+    }
+}
+
+bool RingFile::awaitChunk(int chunk) {
+    while (chunks[chunk].inFlight) {
+        if (!reap(true)) {
+            failed = true;
+            break;
+        }
+    }
+    return !failed;
+}
+
+bool RingFile::write(const void* data, long long size) {
+    const char* source = (const char*)data;
+    while (size > 0 && !failed) {
+        Chunk& chunk = chunks[current];
+        int room = CHUNK_SIZE - chunk.length;
+        int n = size < room ? (int)size : room;
+        memcpy(chunk.data + chunk.length, source, n);
+        chunk.length += n;
+        source += n;
+        size -= n;
+
+        if (chunk.length == CHUNK_SIZE) {
+            queueWrite(current);
+            submitQueued();
+            // Reuse the oldest buffer once its write has landed
+            current = (current + 1) % QUEUE_DEPTH;
+            if (!awaitChunk(current)) return false;
+            chunks[current].length = 0;
+        }
+    }
+    return !failed;
+}
+
+bool RingFile::sync() {
+    if (chunks[current].length > 0) queueWrite(current);
+    if (ringFd != -1) {
+        // DRAIN holds the fsync back until every earlier write completes
+        syncResult = -1;
+        prepare(IORING_OP_FSYNC, SYNC_TAG, IOSQE_IO_DRAIN);
+        submitQueued();
+        while (pending > 0) {
+            if (!reap(true)) {
+                failed = true;
+                break;
+            }
+        }
+        if (!failed && syncResult < 0 && fsync(fd) != 0) failed = true;
+    } else if (!failed && fsync(fd) != 0) {
+        failed = true;
+    }
+    chunks[current].length = 0;
+    return !failed;
+}
+
+void RingFile::startReading() {
+    reading = true;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        failed = true;
+        return;
+    }
+    fileSize = info.st_size;
+    // Queue the whole window of readahead in one submission
+    for (int i = 0; i < QUEUE_DEPTH; i++) queueRead(i);
+    submitQueued();
+}
+
+bool RingFile::read(void* data, long long size) {
+    if (!reading) startReading();
+    char* target = (char*)data;
+    while (size > 0) {
+        if (!awaitChunk(current)) return false;
+        Chunk& chunk = chunks[current];
+        if (chunk.length == 0) return false;  // end of file
+
+        int available = chunk.length - chunk.consumed;
+        if (available == 0) {
+            // Drained: send this buffer further ahead and move on
+            queueRead(current);
+            submitQueued();
+            current = (current + 1) % QUEUE_DEPTH;
+            continue;
+        }
+        int n = size < available ? (int)size : available;
+        memcpy(target, chunk.data + chunk.consumed, n);
+        chunk.consumed += n;
+        target += n;
+        size -= n;
+    }
+    return true;
+}
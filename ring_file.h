@@ -0,0 +1,89 @@
+#ifndef RING_FILE_H
+#define RING_FILE_H
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+// Sequential snapshot I/O in CHUNK_SIZE pieces with up to QUEUE_DEPTH
+// chunks in flight. Writes are gathered into chunks and submitted as each
+// fills; sync() queues an fsync behind them and waits for the lot. Reads
+// keep QUEUE_DEPTH chunks of readahead queued and hand bytes out as the
+// completions arrive.
+//
+// The queue is an io_uring driven through raw syscalls. Where the kernel
+// or a seccomp policy refuses one, the same chunks go through
+// pwrite/pread/fsync instead; callers see no difference. Setting
+// TICKET_IO_URING=0 forces the fallback.
+//
+// One RingFile reads or writes a file, not both.
+class RingFile {
+public:
+    static const int QUEUE_DEPTH = 8;
+    static const int CHUNK_SIZE = 256 * 1024;
+
+    // Starts at offset 0 of fd, which stays owned by the caller
+    explicit RingFile(int fd);
+    ~RingFile();
+
+    bool write(const void* data, long long size);
+    bool read(void* data, long long size);  // false at end of file or on error
+    // Writes everything buffered and makes it durable
+    bool sync();
+
+    bool usingRing() const { return ringFd != -1; }
+
+private:
+    struct Chunk {
+        char* data;
+        int length;        // bytes filled (write) or read (read)
+        int consumed;      // bytes handed out by read()
+        long long offset;  // file position
+        bool inFlight;
+        int result;        // completion result, bytes or -errno
+        struct iovec* vector;
+    };
+
+    int fd;
+    long long nextOffset;  // file position of the next chunk to queue
+    long long fileSize;    // read mode only
+    bool failed;
+    bool reading;
+    Chunk chunks[QUEUE_DEPTH];
+    int current;           // chunk being filled or drained
+
+    // io_uring state; ringFd is -1 when falling back to plain syscalls
+    int ringFd;
+    void* sqRing;
+    void* cqRing;
+    size_t sqRingSize, cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+    int pending;           // queued or submitted, not yet completed
+    int unsubmitted;       // queued since the last io_uring_enter
+    int syncResult;
+
+    bool setupRing();
+    void closeRing();
+    void prepare(unsigned char opcode, int chunk, unsigned char flags);
+    void submitQueued();
+    bool reap(bool wait);   // collects completions; wait blocks for one
+    void complete(int chunk, int result);
+    bool transferRest(Chunk& chunk, int done);  // finishes a chunk with pread/pwrite
+    void queueWrite(int chunk);
+    void queueRead(int chunk);
+    void startReading();
+    bool awaitChunk(int chunk);
+
+    RingFile(const RingFile&);
+    RingFile& operator=(const RingFile&);
+};
+
+#endif // RING_FILE_H
@@ -0,0 +1,243 @@
+#include "server.h"
+#include "checkpoint.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// Stop reading from a peer that is not draining its replies
+const int MAX_PENDING_OUTPUT = 1 << 20;
+
+// Snapshots the system as mutating commands run, if checkpointing
+Checkpointer* serverCheckpointer = nullptr;
+
+struct Connection {
+    int fd;
+    char input[MAX_COMMAND_LEN + 1];
+    int inputLength;
+    OutputBuffer output;
+    int sent;             // bytes of output already written to the socket
+    bool peerClosed;      // peer shut down its write side
+    bool discarding;      // dropping the rest of an overlong line
+    unsigned interest;    // epoll events currently registered
+
+    explicit Connection(int fd) : fd(fd), inputLength(0), sent(0), peerClosed(false), discarding(false), interest(0) {}
+
+    int backlog() const { return output.size() - sent; }
+};
+
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+void runLine(TicketSystem& system, Connection* conn, char* line) {
+    if (line[0] == '\0') return;
+    system.processCommand(line, conn->output);
+    if (serverCheckpointer && !TicketSystem::isReadOnlyCommand(line)) serverCheckpointer->noteCommand(system, line);
+}
+
+// Executes every complete line in the input buffer; at end of input the
+// trailing partial line is executed too, like the stdin loop does. A line
+// that overflows the buffer fails with -1 and is dropped up to its newline.
+void runBufferedCommands(TicketSystem& system, Connection* conn) {
+    int start = 0;
+    if (conn->discarding) {
+        char* newline = (char*)memchr(conn->input, '\n', conn->inputLength);
+        if (!newline) {
+            conn->inputLength = 0;
+            return;
+        }
+        conn->discarding = false;
+        start = newline - conn->input + 1;
+    }
+
+    for (int i = start; i < conn->inputLength; i++) {
+        if (conn->input[i] != '\n') continue;
+        conn->input[i] = '\0';
+        runLine(system, conn, conn->input + start);
+        start = i + 1;
+    }
+
+    if (conn->peerClosed && start < conn->inputLength) {
+        conn->input[conn->inputLength] = '\0';
+        runLine(system, conn, conn->input + start);
+        start = conn->inputLength;
+    } else if (start == 0 && conn->inputLength == MAX_COMMAND_LEN) {
+        conn->output.append("-1\n");
+        conn->discarding = true;
+        start = conn->inputLength;
+    }
+
+    conn->inputLength -= start;
+    memmove(conn->input, conn->input + start, conn->inputLength);
+}
+
+// Returns false if the connection failed
+bool flushOutput(Connection* conn) {
+    while (conn->sent < conn->output.size()) {
+        ssize_t n = send(conn->fd, conn->output.data() + conn->sent, conn->output.size() - conn->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        conn->sent += n;
+    }
+    conn->output.clear();
+    conn->sent = 0;
+    return true;
+}
+
+// Reads while the peer may still send and is draining its replies;
+// writes while replies are pending. Returns false if epoll refused.
+bool updateInterest(int epollFd, Connection* conn) {
+    unsigned interest = 0;
+    if (!conn->peerClosed && conn->backlog() < MAX_PENDING_OUTPUT) interest |= EPOLLIN | EPOLLRDHUP;
+    if (conn->backlog() > 0) interest |= EPOLLOUT;
+    if (interest == conn->interest) return true;
+
+    epoll_event event;
+    event.events = interest;
+    event.data.ptr = conn;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &event) == -1) return false;
+    conn->interest = interest;
+    return true;
+}
+
+void closeConnection(int epollFd, Connection* conn, int& connectionCount) {
+    // Closing the last descriptor drops it from epoll anyway, so a failed
+    // DEL needs no handling
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    close(conn->fd);
+    delete conn;
+    connectionCount--;
+}
+
+// Returns false if the connection failed
+bool readInput(TicketSystem& system, Connection* conn) {
+    while (!conn->peerClosed && conn->backlog() < MAX_PENDING_OUTPUT) {
+        ssize_t n = read(conn->fd, conn->input + conn->inputLength, MAX_COMMAND_LEN - conn->inputLength);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) {
+            conn->peerClosed = true;
+        } else {
+            conn->inputLength += n;
+        }
+        runBufferedCommands(system, conn);
+    }
+    return true;
+}
+
+} // namespace
+
+int runServer(TicketSystem& system, const char* socketPath, Checkpointer* checkpointer) {
+    serverCheckpointer = checkpointer;
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", socketPath);
+        close(listenFd);
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+
+    if (bind(listenFd, (sockaddr*)&address, sizeof(address)) == -1 ||
+        listen(listenFd, SOMAXCONN) == -1 || !setNonBlocking(listenFd)) {
+        perror("bind/listen");
+        close(listenFd);
+        return -1;
+    }
+
+    int epollFd = epoll_create1(0);
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;  // the listening socket
+    if (epollFd == -1 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) == -1) {
+        perror("epoll");
+        if (epollFd != -1) close(epollFd);
+        close(listenFd);
+        unlink(socketPath);
+        return -1;
+    }
+
+    static epoll_event events[256];
+    int connectionCount = 0;
+
+    while (true) {
+        int ready = epoll_wait(epollFd, events, 256, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            Connection* conn = (Connection*)events[i].data.ptr;
+
+            if (!conn) {
+                int clientFd;
+                while ((clientFd = accept(listenFd, nullptr, nullptr)) != -1) {
+                    if (connectionCount >= MAX_CONNECTIONS || !setNonBlocking(clientFd)) {
+                        close(clientFd);
+                        continue;
+                    }
+                    Connection* newConn = new Connection(clientFd);
+                    newConn->interest = EPOLLIN | EPOLLRDHUP;
+                    epoll_event clientEvent;
+                    clientEvent.events = newConn->interest;
+                    clientEvent.data.ptr = newConn;
+                    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &clientEvent) == -1) {
+                        perror("epoll_ctl");
+                        close(clientFd);
+                        delete newConn;
+                        continue;
+                    }
+                    connectionCount++;
+                }
+                continue;
+            }
+
+            bool ok = true;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+                ok = readInput(system, conn);
+            }
+            if (ok) ok = flushOutput(conn);
+            if (ok && (events[i].events & EPOLLERR)) ok = false;
+
+            // A peer that is done sending and has all its replies is finished
+            if (!ok || (conn->peerClosed && conn->output.size() == 0)) {
+                closeConnection(epollFd, conn, connectionCount);
+                continue;
+            }
+
+            if (!updateInterest(epollFd, conn)) {
+                perror("epoll_ctl");
+                closeConnection(epollFd, conn, connectionCount);
+            }
+        }
+    }
+
+    close(epollFd);
+    close(listenFd);
+    unlink(socketPath);
+    return -1;
+}
@@ -0,0 +1,21 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "ticket_system.h"
+
+class Checkpointer;
+
+const int MAX_CONNECTIONS = 1024;
+
+// Serves the stdin line protocol to many frontends over a Unix domain
+// socket. One epoll loop owns every connection; each connection has its
+// own input and output buffer, and requests may be pipelined. Commands
+// from all connections run one at a time against the shared system, in
+// the order their lines complete. A connection closes once its peer has
+// shut down writing and every reply has been sent. With a checkpointer,
+// every mutating command is reported to it as the stdin loop does.
+// Only returns on failure: -1 if the socket cannot be set up or the
+// event loop fails.
+int runServer(TicketSystem& system, const char* socketPath, Checkpointer* checkpointer);
+
+#endif // SERVER_H
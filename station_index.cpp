@@ -0,0 +1,263 @@
+#include "station_index.h"
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+typedef int (*IntersectKernel)(const unsigned long long* a, const unsigned long long* b,
+                               unsigned long long* out);
+
+int intersectScalar(const unsigned long long* a, const unsigned long long* b, unsigned long long* out) {
+    int total = 0;
+    for (int i = 0; i < TRAIN_SET_WORDS; i++) {
+        out[i] = a[i] & b[i];
+        total += __builtin_popcountll(out[i]);
+    }
+    return total;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Popcount per byte via two 4-bit table lookups, summed per 64-bit lane
+// with SAD against zero
+__attribute__((target("avx2")))
+int intersectAvx2(const unsigned long long* a, const unsigned long long* b, unsigned long long* out) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowMask = _mm256_set1_epi8(0x0F);
+    __m256i counts = _mm256_setzero_si256();
+    for (int i = 0; i < TRAIN_SET_WORDS; i += 4) {
+        __m256i both = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                        _mm256_loadu_si256((const __m256i*)(b + i)));
+        _mm256_storeu_si256((__m256i*)(out + i), both);
+        __m256i low = _mm256_shuffle_epi8(table, _mm256_and_si256(both, lowMask));
+        __m256i high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(both, 4), lowMask));
+        counts = _mm256_add_epi64(counts, _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256()));
+    }
+    return (int)(_mm256_extract_epi64(counts, 0) + _mm256_extract_epi64(counts, 1) +
+                 _mm256_extract_epi64(counts, 2) + _mm256_extract_epi64(counts, 3));
+}
+#endif
+
+IntersectKernel selectKernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return intersectAvx2;
+#endif
+    return intersectScalar;
+}
+
+const IntersectKernel intersectKernel = selectKernel();
+
+const int INITIAL_STATIONS = 256;
+
+} // namespace
+
+void TrainSet::clear() {
+    memset(words, 0, sizeof(words));
+}
+
+void TrainSet::unite(const TrainSet& other) {
+    for (int i = 0; i < TRAIN_SET_WORDS; i++) words[i] |= other.words[i];
+}
+
+int intersectTrainSets(const TrainSet& a, const TrainSet& b, TrainSet& out) {
+    return intersectKernel(a.words, b.words, out.words);
+}
+
+const char* trainSetKernel() {
+    return intersectKernel == intersectScalar ? "scalar" : "avx2";
+}
+
+StationIndex::StationIndex() : count(0), initialized(0), capacity(INITIAL_STATIONS) {
+    names = new char[capacity][11];
+    sets = new StationTrains[capacity];
+    bucketMask = capacity * 2 - 1;
+    buckets = new int[bucketMask + 1];
+    bucketStamps = new unsigned int[bucketMask + 1];
+    resetBuckets();
+}
+
+StationIndex::~StationIndex() {
+    for (int station = 0; station < initialized; station++) {
+        delete[] sets[station].serials;
+        delete sets[station].bits;
+        for (int order = 0; order < ORDER_COUNT; order++) delete[] sets[station].ranked[order];
+    }
+    delete[] names;
+    delete[] sets;
+    delete[] buckets;
+    delete[] bucketStamps;
+}
+
+void StationIndex::resetBuckets() {
+    memset(bucketStamps, 0, sizeof(unsigned int) * (bucketMask + 1));
+    generation = 1;
+}
+
+unsigned int StationIndex::hash(const char* name) {
+    unsigned int h = 2166136261u;
+    for (const char* p = name; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int StationIndex::find(const char* name) const {
+    for (unsigned int b = hash(name) & bucketMask;; b = (b + 1) & bucketMask) {
+        if (bucketStamps[b] != generation) return -1;
+        int station = buckets[b];
+        if (strcmp(names[station], name) == 0) return station;
+    }
+}
+
+int StationIndex::intern(const char* name) {
+    int station = find(name);
+    if (station != -1) return station;
+    if (count == capacity) grow();
+
+    station = count++;
+    strncpy(names[station], name, 10);
+    names[station][10] = '\0';
+    StationTrains& set = sets[station];
+    if (station < initialized) {
+        // Left over from before a clear: keep the arrays, drop the bitmap
+        // so the set starts sparse again
+        delete set.bits;
+        set.bits = nullptr;
+    } else {
+        set.capacity = 0;
+        set.serials = nullptr;
+        set.bits = nullptr;
+        for (int order = 0; order < ORDER_COUNT; order++) set.ranked[order] = nullptr;
+        set.rankedCapacity = 0;
+        initialized++;
+    }
+    set.count = 0;
+
+    unsigned int b = hash(names[station]) & bucketMask;
+    while (bucketStamps[b] == generation) b = (b + 1) & bucketMask;
+    buckets[b] = station;
+    bucketStamps[b] = generation;
+    return station;
+}
+
+void StationIndex::grow() {
+    // Double every array; buckets stay at most half full
+    int newCapacity = capacity * 2;
+    char (*newNames)[11] = new char[newCapacity][11];
+    StationTrains* newSets = new StationTrains[newCapacity];
+    memcpy(newNames, names, sizeof(names[0]) * count);
+    memcpy(newSets, sets, sizeof(StationTrains) * initialized);
+    delete[] names;
+    delete[] sets;
+    names = newNames;
+    sets = newSets;
+    capacity = newCapacity;
+
+    delete[] buckets;
+    delete[] bucketStamps;
+    bucketMask = capacity * 2 - 1;
+    buckets = new int[bucketMask + 1];
+    bucketStamps = new unsigned int[bucketMask + 1];
+    resetBuckets();
+    for (int station = 0; station < count; station++) {
+        unsigned int b = hash(names[station]) & bucketMask;
+        while (bucketStamps[b] == generation) b = (b + 1) & bucketMask;
+        buckets[b] = station;
+        bucketStamps[b] = generation;
+    }
+}
+
+bool StationIndex::insertSerial(StationTrains& set, int serial) {
+    if (set.bits) {
+        if (set.bits->test(serial)) return false;
+        set.bits->set(serial);
+        set.count++;
+        return true;
+    }
+
+    int pos = set.count;
+    while (pos > 0 && set.serials[pos - 1] > serial) pos--;
+    if (pos > 0 && set.serials[pos - 1] == serial) return false;
+
+    if (set.count == ARRAY_LIMIT) {
+        // The array would outgrow a bitmap: switch containers
+        set.bits = new TrainSet();
+        set.bits->clear();
+        for (int i = 0; i < set.count; i++) set.bits->set(set.serials[i]);
+        set.bits->set(serial);
+        set.count++;
+        delete[] set.serials;
+        set.serials = nullptr;
+        set.capacity = 0;
+        return true;
+    }
+
+    if (set.count == set.capacity) {
+        int newCapacity = set.capacity ? set.capacity * 2 : 4;
+        unsigned short* grown = new unsigned short[newCapacity];
+        if (set.count) memcpy(grown, set.serials, sizeof(unsigned short) * set.count);
+        delete[] set.serials;
+        set.serials = grown;
+        set.capacity = newCapacity;
+    }
+    memmove(set.serials + pos + 1, set.serials + pos, sizeof(unsigned short) * (set.count - pos));
+    set.serials[pos] = (unsigned short)serial;
+    set.count++;
+    return true;
+}
+
+void StationIndex::add(int station, int serial, const int* keys) {
+    StationTrains& set = sets[station];
+    int before = set.count;
+    if (!insertSerial(set, serial)) return;
+
+    if (set.count > set.rankedCapacity) {
+        int newCapacity = set.rankedCapacity ? set.rankedCapacity * 2 : 4;
+        for (int order = 0; order < ORDER_COUNT; order++) {
+            RankedTrain* grown = new RankedTrain[newCapacity];
+            if (before) memcpy(grown, set.ranked[order], sizeof(RankedTrain) * before);
+            delete[] set.ranked[order];
+            set.ranked[order] = grown;
+        }
+        set.rankedCapacity = newCapacity;
+    }
+    for (int order = 0; order < ORDER_COUNT; order++) {
+        RankedTrain* ranked = set.ranked[order];
+        int pos = before;
+        while (pos > 0 && ranked[pos - 1].key > keys[order]) {
+            ranked[pos] = ranked[pos - 1];
+            pos--;
+        }
+        ranked[pos].key = keys[order];
+        ranked[pos].serial = serial;
+    }
+}
+
+void StationIndex::expand(int station, TrainSet& out) const {
+    const StationTrains& set = sets[station];
+    if (set.bits) {
+        out = *set.bits;
+        return;
+    }
+    out.clear();
+    for (int i = 0; i < set.count; i++) out.set(set.serials[i]);
+}
+
+void StationIndex::addTo(int station, TrainSet& out) const {
+    const StationTrains& set = sets[station];
+    if (set.bits) {
+        out.unite(*set.bits);
+        return;
+    }
+    for (int i = 0; i < set.count; i++) out.set(set.serials[i]);
+}
+
+void StationIndex::clear() {
+    count = 0;
+    // Stamps wrap only after 2^32 clears; then pay for one full reset
+    if (++generation == 0) resetBuckets();
+}
@@ -0,0 +1,97 @@
+#ifndef STATION_INDEX_H
+#define STATION_INDEX_H
+
+#include "utils.h"
+
+// Dense bitmap over train serials (release order), a multiple of 256 bits so the AVX2
+// kernels need no tail handling
+const int TRAIN_SET_WORDS = (MAX_TRAINS + 255) / 256 * 4;
+
+struct TrainSet {
+    unsigned long long words[TRAIN_SET_WORDS];
+
+    void clear();
+    void set(int serial) { words[serial >> 6] |= 1ULL << (serial & 63); }
+    void reset(int serial) { words[serial >> 6] &= ~(1ULL << (serial & 63)); }
+    bool test(int serial) const { return (words[serial >> 6] >> (serial & 63)) & 1; }
+    void unite(const TrainSet& other);
+};
+
+// out = a & b; returns the number of trains in out. Uses AVX2 AND and a
+// nibble-table popcount when the CPU has it, 64-bit words otherwise.
+int intersectTrainSets(const TrainSet& a, const TrainSet& b, TrainSet& out);
+// "avx2" or "scalar", whichever intersectTrainSets dispatches to
+const char* trainSetKernel();
+
+// Per-station orderings of released trains, each sorted by a key fixed at
+// release: cumulative price from the origin, minutes from the origin's
+// departure to leaving the station, and to arriving there
+enum StationOrder { ORDER_PRICE, ORDER_LEAVING, ORDER_ARRIVING, ORDER_COUNT };
+
+struct RankedTrain {
+    int key;
+    int serial;
+};
+
+// Interns station names to dense ids and keeps, per station, the set of
+// released train serials that stop there. Sets are roaring-style: a sorted
+// array of serials while small, a TrainSet bitmap once the array would be
+// larger than the bitmap. Released trains are never deleted and serials
+// never change, so sets only grow and bitmaps stay bitmaps.
+// Alongside each set the station keeps its trains in every StationOrder.
+//
+// clear() runs in constant time: it bumps a generation that retires every
+// bucket at once, and a station's storage is reset lazily when intern
+// hands its id out again.
+class StationIndex {
+public:
+    static const int ARRAY_LIMIT = TRAIN_SET_WORDS * 4;  // as many bytes as a bitmap
+
+    StationIndex();
+    ~StationIndex();
+
+    int intern(const char* name);       // existing or new id
+    int find(const char* name) const;   // -1 if never interned
+    int size() const { return count; }
+
+    // keys[order] is the train's key at this station for each StationOrder
+    void add(int station, int serial, const int* keys);
+    int trainCount(int station) const { return sets[station].count; }
+    // trainCount(station) entries, ascending by key
+    const RankedTrain* ordering(int station, StationOrder order) const { return sets[station].ranked[order]; }
+    // Writes the station's trains into out as a bitmap; addTo ORs them in
+    void expand(int station, TrainSet& out) const;
+    void addTo(int station, TrainSet& out) const;
+
+    void clear();
+
+private:
+    struct StationTrains {
+        int count;
+        int capacity;               // of serials
+        unsigned short* serials;    // sorted, while sparse
+        TrainSet* bits;             // once dense; serials is then unused
+        RankedTrain* ranked[ORDER_COUNT];
+        int rankedCapacity;
+    };
+
+    char (*names)[11];
+    StationTrains* sets;
+    int count;
+    int initialized;  // sets[0, initialized) own storage, possibly stale
+    int capacity;
+    int* buckets;     // open addressing; live only if stamped this generation
+    unsigned int* bucketStamps;
+    unsigned int generation;
+    int bucketMask;
+
+    static unsigned int hash(const char* name);
+    void resetBuckets();
+    void grow();
+    bool insertSerial(StationTrains& set, int serial);  // false if already present
+
+    StationIndex(const StationIndex&);
+    StationIndex& operator=(const StationIndex&);
+};
+
+#endif // STATION_INDEX_H
@@ -0,0 +1,229 @@
+#include "stats.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+
+namespace {
+
+const char* const COMMAND_NAMES[CommandStats::MAX_COMMANDS] = {
+    "add_user", "login", "logout", "query_profile", "modify_profile",
+    "add_train", "release_train", "query_train", "delete_train",
+    "query_ticket", "query_transfer", "buy_ticket", "query_order",
+    "refund_ticket", "clean", "exit", "unknown"
+};
+
+// Single-writer increment: only the owning thread stores to its shard
+template <typename T>
+inline void bump(std::atomic<T>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+#ifdef ENABLE_ALLOC_STATS
+// Counted by the global operator new below
+thread_local long long allocationCount = 0;
+
+void* countedAllocate(size_t size) {
+    allocationCount++;
+    return malloc(size > 0 ? size : 1);
+}
+
+void* countedAllocateAligned(size_t size, std::align_val_t alignment) {
+    allocationCount++;
+    size_t align = (size_t)alignment;
+    // aligned_alloc wants a multiple of the alignment
+    return aligned_alloc(align, size > 0 ? (size + align - 1) / align * align : align);
+}
+#endif
+
+} // namespace
+
+#ifdef ENABLE_ALLOC_STATS
+// Replacing the global allocator is the only way to see every heap
+// allocation, including those made inside the standard library. Every
+// replaceable form is covered so no allocation bypasses the count.
+void* operator new(size_t size) {
+    void* memory = countedAllocate(size);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    void* memory = countedAllocateAligned(size, alignment);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocateAligned(size, alignment);
+}
+
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { free(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { free(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { free(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept { free(memory); }
+#endif
+
+CommandStats& CommandStats::instance() {
+    static CommandStats stats;
+    return stats;
+}
+
+CommandStats::CommandStats() : shardCount(0) {
+    for (int i = 0; i < MAX_SHARDS; i++) shards[i] = nullptr;
+}
+
+int CommandStats::commandIndex(const char* name) {
+    for (int i = 0; i < MAX_COMMANDS - 1; i++) {
+        if (strcmp(name, COMMAND_NAMES[i]) == 0) return i;
+    }
+    return MAX_COMMANDS - 1;
+}
+
+const char* CommandStats::commandName(int command) {
+    return COMMAND_NAMES[command];
+}
+
+long long CommandStats::nowNanos() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+long long CommandStats::threadAllocations() {
+#ifdef ENABLE_ALLOC_STATS
+    return allocationCount;
+#else
+    return 0;
+#endif
+}
+
+CommandStats::Shard* CommandStats::localShard() {
+    thread_local Shard* shard = nullptr;
+    thread_local bool assigned = false;
+    if (!assigned) {
+        assigned = true;
+        // Threads beyond MAX_SHARDS go unrecorded
+        int index = shardCount.fetch_add(1);
+        if (index < MAX_SHARDS) {
+            shard = new Shard();
+            shards[index] = shard;
+        }
+    }
+    return shard;
+}
+
+int CommandStats::bucketOf(unsigned long long nanos) {
+    if (nanos < 16) return (int)nanos;
+    int exponent = 63 - __builtin_clzll(nanos);
+    int sub = (int)(nanos >> (exponent - 3)) & 7;
+    return 16 + (exponent - 4) * 8 + sub;
+}
+
+unsigned long long CommandStats::bucketUpperBound(int bucket) {
+    if (bucket < 16) return bucket;
+    int exponent = (bucket - 16) / 8 + 4;
+    int sub = (bucket - 16) % 8;
+    return ((unsigned long long)(9 + sub) << (exponent - 3)) - 1;
+}
+
+void CommandStats::record(int command, long long nanos, bool failed, long long allocations) {
+    Shard* shard = localShard();
+    if (!shard) return;
+    if (nanos < 0) nanos = 0;
+
+    bump(shard->count[command]);
+    if (failed) bump(shard->failed[command]);
+    if ((unsigned long long)nanos > shard->maxNanos[command].load(std::memory_order_relaxed)) {
+        shard->maxNanos[command].store(nanos, std::memory_order_relaxed);
+    }
+    bump(shard->buckets[command][bucketOf(nanos)]);
+    shard->allocations[command].store(shard->allocations[command].load(std::memory_order_relaxed) + allocations,
+                                      std::memory_order_relaxed);
+}
+
+void CommandStats::report(OutputBuffer& out) {
+    int shardTotal = shardCount.load();
+    if (shardTotal > MAX_SHARDS) shardTotal = MAX_SHARDS;
+
+    static const double PERCENTILES[] = {0.50, 0.99, 0.999};
+    unsigned int* merged = new unsigned int[HISTOGRAM_BUCKETS];
+
+    out.append("command count failed p50_ns p99_ns p999_ns max_ns allocs\n");
+    for (int c = 0; c < MAX_COMMANDS; c++) {
+        unsigned long long count = 0, failed = 0, maxNanos = 0, allocations = 0;
+        memset(merged, 0, sizeof(unsigned int) * HISTOGRAM_BUCKETS);
+        for (int s = 0; s < shardTotal; s++) {
+            Shard* shard = shards[s];
+            if (!shard) continue;
+            count += shard->count[c].load(std::memory_order_relaxed);
+            failed += shard->failed[c].load(std::memory_order_relaxed);
+            allocations += shard->allocations[c].load(std::memory_order_relaxed);
+            unsigned long long shardMax = shard->maxNanos[c].load(std::memory_order_relaxed);
+            if (shardMax > maxNanos) maxNanos = shardMax;
+            for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+                merged[b] += shard->buckets[c][b].load(std::memory_order_relaxed);
+            }
+        }
+        if (count == 0) continue;
+
+        // Bucket counts may trail count by in-flight records; use their sum
+        unsigned long long histogramTotal = 0;
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++) histogramTotal += merged[b];
+
+        unsigned long long values[3];
+        for (int p = 0; p < 3; p++) {
+            unsigned long long rank = (unsigned long long)(PERCENTILES[p] * histogramTotal);
+            unsigned long long seen = 0;
+            int b = 0;
+            while (b < HISTOGRAM_BUCKETS - 1 && seen + merged[b] <= rank) seen += merged[b++];
+            values[p] = bucketUpperBound(b) < maxNanos ? bucketUpperBound(b) : maxNanos;
+        }
+#ifdef ENABLE_ALLOC_STATS
+        out.append("%s %llu %llu %llu %llu %llu %llu %llu\n", COMMAND_NAMES[c], count, failed,
+                   values[0], values[1], values[2], maxNanos, allocations);
+#else
+        out.append("%s %llu %llu %llu %llu %llu %llu -\n", COMMAND_NAMES[c], count, failed,
+                   values[0], values[1], values[2], maxNanos);
+#endif
+    }
+    delete[] merged;
+}
+
+bool CommandStats::dumpToFile(const char* path) {
+    OutputBuffer out;
+    report(out);
+    FILE* file = fopen(path, "w");
+    if (!file) return false;
+    bool ok = fwrite(out.data(), 1, out.size(), file) == (size_t)out.size();
+    return fclose(file) == 0 && ok;
+}
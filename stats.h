@@ -0,0 +1,62 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include "utils.h"
+
+// Per-command counters and latency histograms. Each thread records into
+// its own shard with plain relaxed stores, so recording costs a clock read
+// and a few cache-local increments; readers sum the shards on demand.
+//
+// Latencies are bucketed HDR-style: exact below 16ns, then 8 linear
+// sub-buckets per power of two, so any reported percentile is within
+// 12.5% of the true value.
+class CommandStats {
+public:
+    static const int MAX_COMMANDS = 17;  // 16 README commands + unknown
+    static const int HISTOGRAM_BUCKETS = 16 + 60 * 8;
+    static const int MAX_SHARDS = 256;
+
+    static CommandStats& instance();
+
+    // Index of a command name for record(); unknown names share a slot
+    static int commandIndex(const char* name);
+    static const char* commandName(int command);
+    static long long nowNanos();
+
+    // Global operator new calls made by this thread so far; the difference
+    // across a command is what record() takes as allocations. Only built
+    // with ENABLE_ALLOC_STATS, which replaces the global allocator for the
+    // whole program; otherwise always 0 and report() prints "-".
+    static long long threadAllocations();
+
+    // failed: the reply was "-1"
+    void record(int command, long long nanos, bool failed, long long allocations);
+
+    // One line per command seen so far: count, -1 count, latency
+    // percentiles in nanoseconds and heap allocations made
+    void report(OutputBuffer& out);
+    bool dumpToFile(const char* path);
+
+private:
+    struct Shard {
+        std::atomic<unsigned long long> count[MAX_COMMANDS];
+        std::atomic<unsigned long long> failed[MAX_COMMANDS];
+        std::atomic<unsigned long long> maxNanos[MAX_COMMANDS];
+        std::atomic<unsigned long long> allocations[MAX_COMMANDS];
+        std::atomic<unsigned int> buckets[MAX_COMMANDS][HISTOGRAM_BUCKETS];
+    };
+
+    Shard* shards[MAX_SHARDS];
+    std::atomic<int> shardCount;
+
+    CommandStats();
+    CommandStats(const CommandStats&);
+    CommandStats& operator=(const CommandStats&);
+
+    Shard* localShard();
+    static int bucketOf(unsigned long long nanos);
+    static unsigned long long bucketUpperBound(int bucket);
+};
+
+#endif // STATS_H
@@ -0,0 +1,129 @@
+#include "thread_pool.h"
+
+bool ThreadPool::WorkDeque::push(const Task& task) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (tail - head >= DEQUE_CAPACITY) return false;
+    tasks[tail++ % DEQUE_CAPACITY] = task;
+    return true;
+}
+
+bool ThreadPool::WorkDeque::popBack(Task& task) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (head == tail) return false;
+    task = tasks[--tail % DEQUE_CAPACITY];
+    return true;
+}
+
+bool ThreadPool::WorkDeque::stealFront(Task& task) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (head == tail) return false;
+    task = tasks[head++ % DEQUE_CAPACITY];
+    if (head == tail) head = tail = 0;
+    return true;
+}
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::ThreadPool() : workers(nullptr), numWorkers(0), nextDeque(0), queuedTasks(0), stopping(false) {
+    // The calling thread always participates, so spawn one fewer worker
+    int hardware = (int)std::thread::hardware_concurrency();
+    numWorkers = hardware > 1 ? hardware - 1 : 0;
+    if (numWorkers > MAX_WORKERS) numWorkers = MAX_WORKERS;
+
+    if (numWorkers > 0) {
+        workers = new std::thread[numWorkers];
+        for (int i = 0; i < numWorkers; i++) {
+            workers[i] = std::thread(&ThreadPool::workerLoop, this, i);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    stopping = true;
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        wakeup.notify_all();
+    }
+    for (int i = 0; i < numWorkers; i++) {
+        workers[i].join();
+    }
+    delete[] workers;
+}
+
+void ThreadPool::runTask(const Task& task) {
+    task.job->func(task.job->context, task.begin, task.end);
+    task.job->remaining.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+bool ThreadPool::findTask(int preferred, Task& task) {
+    bool found = preferred >= 0 && deques[preferred].popBack(task);
+    for (int i = 0; !found && i < numWorkers; i++) {
+        int victim = (preferred + 1 + i) % numWorkers;
+        found = deques[victim].stealFront(task);
+    }
+    if (found) queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+    return found;
+}
+
+void ThreadPool::workerLoop(int id) {
+    Task task;
+    while (!stopping) {
+        if (findTask(id, task)) {
+            runTask(task);
+            continue;
+        }
+        // Sleep until something is queued; every push bumps queuedTasks
+        // before notifying under sleepLock, so no wakeup is lost
+        std::unique_lock<std::mutex> guard(sleepLock);
+        while (!stopping && queuedTasks.load(std::memory_order_relaxed) <= 0) {
+            wakeup.wait(guard);
+        }
+    }
+}
+
+void ThreadPool::parallelFor(int count, int grain, RangeFunc func, void* context) {
+    if (count <= 0) return;
+    if (grain < 1) grain = 1;
+
+    if (numWorkers == 0 || count <= grain) {
+        func(context, 0, count);
+        return;
+    }
+
+    Job job;
+    job.func = func;
+    job.context = context;
+    job.remaining = (count + grain - 1) / grain;
+
+    for (int begin = 0; begin < count; begin += grain) {
+        Task task;
+        task.job = &job;
+        task.begin = begin;
+        task.end = begin + grain < count ? begin + grain : count;
+
+        int target = nextDeque.fetch_add(1, std::memory_order_relaxed) % numWorkers;
+        queuedTasks.fetch_add(1, std::memory_order_relaxed);
+        if (!deques[target].push(task)) {
+            queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            runTask(task);  // deque full: run it here instead
+        }
+    }
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        wakeup.notify_all();
+    }
+
+    // Help out until every chunk of this job is done; tasks from other
+    // jobs are fair game too, which keeps nested parallelFor calls live
+    Task task;
+    while (job.remaining.load(std::memory_order_acquire) > 0) {
+        if (findTask(-1, task)) {
+            runTask(task);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Small work-stealing pool for data-parallel loops. parallelFor splits an
+// index range into chunks spread over the workers' deques; idle workers
+// steal from the front of other deques, and the calling thread helps until
+// every chunk has run, so nested calls from inside a task cannot deadlock.
+class ThreadPool {
+public:
+    typedef void (*RangeFunc)(void* context, int begin, int end);
+
+    static ThreadPool& instance();
+
+    // Runs func over [0, count) in chunks of at most grain indices and
+    // returns once all of them have finished
+    void parallelFor(int count, int grain, RangeFunc func, void* context);
+
+    int workerCount() const { return numWorkers; }
+
+    ~ThreadPool();
+
+private:
+    struct Job {
+        RangeFunc func;
+        void* context;
+        std::atomic<int> remaining;
+    };
+
+    struct Task {
+        Job* job;
+        int begin, end;
+    };
+
+    static const int MAX_WORKERS = 16;
+    static const int DEQUE_CAPACITY = 256;
+
+    struct WorkDeque {
+        std::mutex lock;
+        Task tasks[DEQUE_CAPACITY];
+        int head, tail;  // tasks live in [head, tail), indices modulo capacity
+
+        WorkDeque() : head(0), tail(0) {}
+        bool push(const Task& task);
+        bool popBack(Task& task);
+        bool stealFront(Task& task);
+    };
+
+    WorkDeque deques[MAX_WORKERS];
+    std::thread* workers;
+    int numWorkers;
+    std::atomic<int> nextDeque;
+    std::atomic<int> queuedTasks;  // pushed and not yet taken; workers sleep at 0
+    std::atomic<bool> stopping;
+    std::mutex sleepLock;
+    std::condition_variable wakeup;
+
+    ThreadPool();
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void workerLoop(int id);
+    bool findTask(int preferred, Task& task);
+    static void runTask(const Task& task);
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,599 @@
+#include "ticket_system.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include "thread_pool.h"
+#include "stats.h"
+#include "trace.h"
+#include "arena.h"
+#include <new>
+
+void TicketSystem::processCommand(const char* command) {
+    OutputBuffer out;
+    processCommand(command, out);
+    fwrite(out.data(), 1, out.size(), stdout);
+}
+
+void TicketSystem::processCommand(const char* command, OutputBuffer& out) {
+    long long startNanos = CommandStats::nowNanos();
+    long long startAllocations = CommandStats::threadAllocations();
+    int replyStart = out.size();
+    TRACE_SCOPE("processCommand");
+    // Every temporary of this command is released when it returns
+    ArenaScope scope;
+    char cmd[32] = "";
+    char args[MAX_COMMAND_LEN] = "";
+
+    // Parse command
+    {
+        TRACE_SCOPE("processCommand.tokenize");
+        int parsed = sscanf(command, "%s %[^\n]", cmd, args);
+        if (parsed == 1) {
+            args[0] = '\0'; // No arguments
+        }
+    }
+
+    if (strcmp(cmd, "clean") == 0) {
+        handleClean(out);
+    } else if (strcmp(cmd, "exit") == 0) {
+        handleExit(out);
+    } else if (strcmp(cmd, "add_user") == 0) {
+        handleAddUser(args, out);
+    } else if (strcmp(cmd, "login") == 0) {
+        handleLogin(args, out);
+    } else if (strcmp(cmd, "logout") == 0) {
+        handleLogout(args, out);
+    } else if (strcmp(cmd, "query_profile") == 0) {
+        handleQueryProfile(args, out);
+    } else if (strcmp(cmd, "modify_profile") == 0) {
+        handleModifyProfile(args, out);
+    } else if (strcmp(cmd, "add_train") == 0) {
+        handleAddTrain(args, out);
+    } else if (strcmp(cmd, "release_train") == 0) {
+        handleReleaseTrain(args, out);
+    } else if (strcmp(cmd, "query_train") == 0) {
+        handleQueryTrain(args, out);
+    } else if (strcmp(cmd, "delete_train") == 0) {
+        handleDeleteTrain(args, out);
+    } else if (strcmp(cmd, "query_ticket") == 0) {
+        handleQueryTicket(args, out);
+    } else if (strcmp(cmd, "query_transfer") == 0) {
+        handleQueryTransfer(args, out);
+    } else if (strcmp(cmd, "buy_ticket") == 0) {
+        handleBuyTicket(args, out);
+    } else if (strcmp(cmd, "query_order") == 0) {
+        handleQueryOrder(args, out);
+    } else if (strcmp(cmd, "refund_ticket") == 0) {
+        handleRefundTicket(args, out);
+    } else if (strcmp(cmd, "stats") == 0) {
+        // Hidden diagnostics command; not counted in its own report
+        CommandStats::instance().report(out);
+        return;
+    } else {
+        out.append("-1\n");
+    }
+
+    bool failed = out.size() - replyStart == 3 && memcmp(out.data() + replyStart, "-1\n", 3) == 0;
+    CommandStats::instance().record(CommandStats::commandIndex(cmd), CommandStats::nowNanos() - startNanos,
+                                    failed, CommandStats::threadAllocations() - startAllocations);
+
+    // Mutating commands never overlap other commands, so this is where
+    // the train slot compactor gets its incremental step, and where
+    // train tables no reader can hold any more are freed
+    if (!isReadOnlyCommand(command)) {
+        trainManager.compactStep();
+        trainManager.reclaimSnapshots();
+    }
+}
+
+namespace {
+
+struct ReadOnlyBatch {
+    TicketSystem* system;
+    const char* const* commands;
+    OutputBuffer* outputs;
+};
+
+void runReadOnlyRange(void* context, int begin, int end) {
+    ReadOnlyBatch* batch = (ReadOnlyBatch*)context;
+    for (int i = begin; i < end; i++) {
+        batch->system->processCommand(batch->commands[i], batch->outputs[i]);
+    }
+}
+
+struct AddTrainBatch {
+    TicketSystem* system;
+    const char* const* commands;
+    Train* staged;
+    bool* parsed;
+};
+
+void stageAddTrainRange(void* context, int begin, int end) {
+    AddTrainBatch* batch = (AddTrainBatch*)context;
+    for (int i = begin; i < end; i++) {
+        ArenaScope scope;
+        const char* args = batch->commands[i] + strlen("add_train");
+        while (*args == ' ') args++;
+        batch->parsed[i] = batch->system->stageAddTrain(args, batch->staged[i]);
+    }
+}
+
+} // namespace
+
+void TicketSystem::processReadOnlyBatch(const char* const* commands, int count, OutputBuffer* outputs) {
+    ReadOnlyBatch batch = {this, commands, outputs};
+    ThreadPool::instance().parallelFor(count, 1, runReadOnlyRange, &batch);
+}
+
+void TicketSystem::processAddTrainBatch(const char* const* commands, int count, OutputBuffer* outputs) {
+    long long startNanos = CommandStats::nowNanos();
+    long long startAllocations = CommandStats::threadAllocations();
+    ArenaScope scope;
+    Train* staged = Arena::current().allocateArray<Train>(count);
+    for (int i = 0; i < count; i++) new (&staged[i]) Train();
+    bool parsed[MAX_READ_BATCH];
+    int results[MAX_READ_BATCH];
+
+    // Parsing is independent per command; committing happens in one
+    // sorted pass so the ID index is extended bottom-up
+    AddTrainBatch batch = {this, commands, staged, parsed};
+    ThreadPool::instance().parallelFor(count, 4, stageAddTrainRange, &batch);
+    trainManager.addParsedTrains(staged, parsed, count, results);
+    trainManager.compactStep();
+    trainManager.reclaimSnapshots();
+
+    // Commands in the batch share its cost evenly; allocations made by
+    // workers are not seen from this thread
+    int addTrain = CommandStats::commandIndex("add_train");
+    long long perCommand = (CommandStats::nowNanos() - startNanos) / count;
+    long long allocations = CommandStats::threadAllocations() - startAllocations;
+    for (int i = 0; i < count; i++) {
+        outputs[i].append("%d\n", results[i]);
+        CommandStats::instance().record(addTrain, perCommand, results[i] == -1,
+                                        allocations / count + (i < allocations % count));
+    }
+}
+
+bool TicketSystem::isAddTrainCommand(const char* command) {
+    return strncmp(command, "add_train", 9) == 0 && (command[9] == ' ' || command[9] == '\0');
+}
+
+void TicketSystem::prefetchCommand(const char* line, int length) const {
+    // Only the ID arguments map to index pages: -u and -c name users,
+    // -i names a train. Values too long to be IDs are skipped.
+    const char* end = line + length;
+    for (const char* p = line; p + 3 < end; p++) {
+        if (p[0] != ' ' || p[1] != '-' || p[3] != ' ') continue;
+        char flag = p[2];
+        if (flag != 'u' && flag != 'c' && flag != 'i') continue;
+
+        const char* value = p + 4;
+        int valueLength = 0;
+        while (value + valueLength < end && value[valueLength] != ' ') valueLength++;
+        if (valueLength == 0 || valueLength > MAX_ID_LEN) continue;
+
+        char id[MAX_ID_LEN + 1];
+        memcpy(id, value, valueLength);
+        id[valueLength] = '\0';
+        if (flag == 'i') {
+            trainManager.prefetchTrain(id);
+        } else {
+            userManager.prefetchUser(id);
+        }
+        p = value + valueLength - 1;
+    }
+}
+
+bool TicketSystem::isReadOnlyCommand(const char* command) {
+    // Commands that never change user, train, seat or order state
+    static const char* const READ_ONLY[] = {
+        "query_profile", "query_train", "query_ticket", "query_transfer", "query_order", "stats"
+    };
+    char cmd[32];
+    if (sscanf(command, "%31s", cmd) != 1) return false;
+    for (unsigned i = 0; i < sizeof(READ_ONLY) / sizeof(READ_ONLY[0]); i++) {
+        if (strcmp(cmd, READ_ONLY[i]) == 0) return true;
+    }
+    return false;
+}
+
+void TicketSystem::parseArgs(const char* args, char* keys[], char* values[], int& count) {
+    TRACE_SCOPE("TicketSystem::parseArgs");
+    count = 0;
+    if (!args || strlen(args) == 0) return;
+
+    // Keys and values point into one arena copy of the arguments
+    char* argsCopy = Arena::current().copyString(args);
+
+    char* save = nullptr;
+    char* token = strtok_r(argsCopy, " ", &save);
+    while (token != nullptr && count < 20) {
+        if (token[0] == '-' && strlen(token) == 2) {
+            char* key = token;
+            token = strtok_r(nullptr, " ", &save);
+            if (token != nullptr) {
+                keys[count] = key;
+                values[count] = token;
+                count++;
+            }
+        }
+        token = strtok_r(nullptr, " ", &save);
+    }
+}
+
+const char* TicketSystem::getArgValue(char* keys[], char* values[], int count, const char* key) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(keys[i], key) == 0) {
+            return values[i];
+        }
+    }
+    return nullptr;
+}
+
+void TicketSystem::handleAddUser(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* curUsername = getArgValue(keys, values, count, "-c");
+    const char* username = getArgValue(keys, values, count, "-u");
+    const char* password = getArgValue(keys, values, count, "-p");
+    const char* name = getArgValue(keys, values, count, "-n");
+    const char* mailAddr = getArgValue(keys, values, count, "-m");
+    const char* privilegeStr = getArgValue(keys, values, count, "-g");
+
+    if (!username || !password || !name || !mailAddr) {
+        out.append("-1\n");
+        return;
+    }
+
+    int privilege = privilegeStr ? parseInt(privilegeStr) : 0;
+
+    // For first user, ignore -c and -g parameters
+    int result;
+    if (!userManager.isFirstUserAdded()) {
+        result = userManager.addUser(nullptr, username, password, name, mailAddr, 10);
+    } else {
+        result = userManager.addUser(curUsername, username, password, name, mailAddr, privilege);
+    }
+    out.append("%d\n", result);
+}
+
+void TicketSystem::handleLogin(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* username = getArgValue(keys, values, count, "-u");
+    const char* password = getArgValue(keys, values, count, "-p");
+
+    if (!username || !password) {
+        out.append("-1\n");
+        return;
+    }
+
+    int result = userManager.login(username, password);
+    out.append("%d\n", result);
+}
+
+void TicketSystem::handleLogout(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* username = getArgValue(keys, values, count, "-u");
+
+    if (!username) {
+        out.append("-1\n");
+        return;
+    }
+
+    int result = userManager.logout(username);
+    out.append("%d\n", result);
+}
+
+void TicketSystem::handleQueryProfile(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* curUsername = getArgValue(keys, values, count, "-c");
+    const char* username = getArgValue(keys, values, count, "-u");
+
+    if (!curUsername || !username) {
+        out.append("-1\n");
+        return;
+    }
+
+    char result[256];
+    int ret = userManager.queryProfile(curUsername, username, result);
+    if (ret == 0) {
+        out.append("%s\n", result);
+    } else {
+        out.append("-1\n");
+    }
+}
+
+void TicketSystem::handleModifyProfile(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* curUsername = getArgValue(keys, values, count, "-c");
+    const char* username = getArgValue(keys, values, count, "-u");
+    const char* password = getArgValue(keys, values, count, "-p");
+    const char* name = getArgValue(keys, values, count, "-n");
+    const char* mailAddr = getArgValue(keys, values, count, "-m");
+    const char* privilegeStr = getArgValue(keys, values, count, "-g");
+
+    if (!curUsername || !username) {
+        out.append("-1\n");
+        return;
+    }
+
+    int privilege = privilegeStr ? parseInt(privilegeStr) : -1;
+    char result[256];
+    int ret = userManager.modifyProfile(curUsername, username, password, name, mailAddr, privilege, result);
+    if (ret == 0) {
+        out.append("%s\n", result);
+    } else {
+        out.append("-1\n");
+    }
+}
+
+bool TicketSystem::stageAddTrain(const char* args, Train& train) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* trainID = getArgValue(keys, values, count, "-i");
+    const char* stationNumStr = getArgValue(keys, values, count, "-n");
+    const char* seatNumStr = getArgValue(keys, values, count, "-m");
+    const char* stations = getArgValue(keys, values, count, "-s");
+    const char* prices = getArgValue(keys, values, count, "-p");
+    const char* startTime = getArgValue(keys, values, count, "-x");
+    const char* travelTimes = getArgValue(keys, values, count, "-t");
+    const char* stopoverTimes = getArgValue(keys, values, count, "-o");
+    const char* saleDate = getArgValue(keys, values, count, "-d");
+    const char* type = getArgValue(keys, values, count, "-y");
+
+    bool parsed = false;
+    if (trainID && stationNumStr && seatNumStr && stations && prices &&
+        startTime && travelTimes && stopoverTimes && saleDate && type) {
+        parsed = trainManager.parseTrain(trainID, parseInt(stationNumStr), parseInt(seatNumStr), stations,
+                                         prices, startTime, travelTimes, stopoverTimes, saleDate, type[0], train);
+    }
+    return parsed;
+}
+
+void TicketSystem::handleAddTrain(const char* args, OutputBuffer& out) {
+    bool parsed = stageAddTrain(args, stagingTrain);
+    int result;
+    trainManager.addParsedTrains(&stagingTrain, &parsed, 1, &result);
+    out.append("%d\n", result);
+}
+
+void TicketSystem::handleReleaseTrain(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* trainID = getArgValue(keys, values, count, "-i");
+
+    if (!trainID) {
+        out.append("-1\n");
+        return;
+    }
+
+    int result = trainManager.releaseTrain(trainID);
+    out.append("%d\n", result);
+}
+
+void TicketSystem::handleQueryTrain(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* trainID = getArgValue(keys, values, count, "-i");
+    const char* date = getArgValue(keys, values, count, "-d");
+
+    if (!trainID || !date) {
+        out.append("-1\n");
+        return;
+    }
+
+    char* result = Arena::current().allocateArray<char>(MAX_STATIONS * 128);
+    int ret = trainManager.queryTrain(trainID, date, result);
+    if (ret == 0) {
+        out.append("%s", result);
+    } else {
+        out.append("-1\n");
+    }
+}
+
+void TicketSystem::handleDeleteTrain(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* trainID = getArgValue(keys, values, count, "-i");
+
+    if (!trainID) {
+        out.append("-1\n");
+        return;
+    }
+
+    int result = trainManager.deleteTrain(trainID);
+    out.append("%d\n", result);
+}
+
+void TicketSystem::handleQueryTicket(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* fromStation = getArgValue(keys, values, count, "-s");
+    const char* toStation = getArgValue(keys, values, count, "-t");
+    const char* date = getArgValue(keys, values, count, "-d");
+    const char* priority = getArgValue(keys, values, count, "-p");
+    const char* limit = getArgValue(keys, values, count, "-k");
+
+    if (!fromStation || !toStation || !date || (limit && parseInt(limit) <= 0)) {
+        out.append("-1\n");
+        return;
+    }
+
+    char* result = Arena::current().allocateArray<char>(MAX_TRAINS * 128);
+    const char* priorityStr = priority ? priority : "time";
+    // -k <n>: only the best n trains
+    int ret = limit ? trainManager.queryTicketTop(fromStation, toStation, date, priorityStr, parseInt(limit), result)
+                    : trainManager.queryTicket(fromStation, toStation, date, priorityStr, result);
+    if (ret == 0) {
+        out.append("%s", result);
+    } else {
+        out.append("-1\n");
+    }
+}
+
+void TicketSystem::handleQueryTransfer(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* fromStation = getArgValue(keys, values, count, "-s");
+    const char* toStation = getArgValue(keys, values, count, "-t");
+    const char* date = getArgValue(keys, values, count, "-d");
+    const char* priority = getArgValue(keys, values, count, "-p");
+
+    if (!fromStation || !toStation || !date) {
+        out.append("-1\n");
+        return;
+    }
+
+    char* result = Arena::current().allocateArray<char>(4096);
+    const char* priorityStr = priority ? priority : "time";
+    int ret = trainManager.queryTransfer(fromStation, toStation, date, priorityStr, result);
+    if (ret == 0) {
+        out.append("%s", result);
+    } else {
+        out.append("0\n");
+    }
+}
+
+void TicketSystem::handleBuyTicket(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* username = getArgValue(keys, values, count, "-u");
+    const char* trainID = getArgValue(keys, values, count, "-i");
+    const char* date = getArgValue(keys, values, count, "-d");
+    const char* numTicketsStr = getArgValue(keys, values, count, "-n");
+    const char* fromStation = getArgValue(keys, values, count, "-f");
+    const char* toStation = getArgValue(keys, values, count, "-t");
+    const char* queueStr = getArgValue(keys, values, count, "-q");
+
+    if (!username || !trainID || !date || !numTicketsStr || !fromStation || !toStation) {
+        out.append("-1\n");
+        return;
+    }
+
+    if (!userManager.isUserLoggedIn(username)) {
+        out.append("-1\n");
+        return;
+    }
+
+    int numTickets = parseInt(numTicketsStr);
+    bool queueIfUnavailable = queueStr ? (strcmp(queueStr, "true") == 0) : false;
+    int totalPrice;
+
+    int result = orderManager.buyTicket(username, trainID, date, numTickets,
+                                       fromStation, toStation, queueIfUnavailable, totalPrice, &trainManager);
+
+    if (result == -1) {
+        out.append("-1\n");
+    } else if (result == -2) { // queue
+        out.append("queue\n");
+    } else {
+        out.append("%d\n", result);
+    }
+}
+
+void TicketSystem::handleQueryOrder(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* username = getArgValue(keys, values, count, "-u");
+
+    if (!username) {
+        out.append("-1\n");
+        return;
+    }
+
+    if (!userManager.isUserLoggedIn(username)) {
+        out.append("-1\n");
+        return;
+    }
+
+    char* result;
+    int ret = orderManager.queryOrder(username, result);
+    if (ret == 0) {
+        out.append("%s", result);
+    } else {
+        out.append("-1\n");
+    }
+}
+
+void TicketSystem::handleRefundTicket(const char* args, OutputBuffer& out) {
+    char* keys[20], *values[20];
+    int count;
+    parseArgs(args, keys, values, count);
+
+    const char* username = getArgValue(keys, values, count, "-u");
+    const char* orderIndexStr = getArgValue(keys, values, count, "-n");
+
+    if (!username) {
+        out.append("-1\n");
+        return;
+    }
+
+    if (!userManager.isUserLoggedIn(username)) {
+        out.append("-1\n");
+        return;
+    }
+
+    int orderIndex = orderIndexStr ? parseInt(orderIndexStr) : 1;
+    int result = orderManager.refundTicket(username, orderIndex);
+    out.append("%d\n", result);
+}
+
+void TicketSystem::handleClean(OutputBuffer& out) {
+    clear();
+    out.append("0\n");
+}
+
+void TicketSystem::clear() {
+    generation++;
+    userManager.clean();
+    trainManager.clean();
+    orderManager.clean();
+}
+
+bool TicketSystem::save(RingFile& file) {
+    return userManager.save(file) && trainManager.save(file) && orderManager.save(file);
+}
+
+bool TicketSystem::load(RingFile& file) {
+    return userManager.load(file) && trainManager.load(file) && orderManager.load(file);
+}
+
+void TicketSystem::handleExit(OutputBuffer& out) {
+    const char* statsPath = getenv("TICKET_STATS_FILE");
+    if (statsPath) CommandStats::instance().dumpToFile(statsPath);
+#ifdef ENABLE_TRACE
+    const char* tracePath = getenv("TICKET_TRACE_FILE");
+    if (tracePath) Tracer::exportChromeJson(tracePath);
+#endif
+    out.append("bye\n");
+}
@@ -0,0 +1,80 @@
+#ifndef TICKET_SYSTEM_H
+#define TICKET_SYSTEM_H
+
+#include "utils.h"
+#include "user.h"
+#include "train.h"
+#include "order.h"
+
+// Commands gathered ahead into one read-only or add_train batch
+const int MAX_READ_BATCH = 64;
+
+class TicketSystem {
+private:
+    UserManager userManager;
+    TrainManager trainManager;
+    OrderManager orderManager;
+    Train stagingTrain;  // parse target for single add_train commands
+    unsigned int generation;  // bumped by every clean
+
+public:
+    TicketSystem() : generation(1) {}
+
+    void processCommand(const char* command);
+    void processCommand(const char* command, OutputBuffer& out);
+
+    // Runs read-only commands concurrently; outputs[i] receives the reply
+    // to commands[i]. Only valid while no mutating command is running.
+    void processReadOnlyBatch(const char* const* commands, int count, OutputBuffer* outputs);
+
+    // Runs consecutive add_train commands: arguments are parsed in
+    // parallel and the trains are committed together, in input order
+    void processAddTrainBatch(const char* const* commands, int count, OutputBuffer* outputs);
+
+    // Hints the index pages an upcoming command line (not yet executed,
+    // not null-terminated) will look up. Reads only; never changes state.
+    void prefetchCommand(const char* line, int length) const;
+
+    static bool isReadOnlyCommand(const char* command);
+    static bool isAddTrainCommand(const char* command);
+
+    // Parses add_train arguments into a staging record; thread-safe
+    bool stageAddTrain(const char* args, Train& train);
+
+    // Drops all data (what the clean command does, without the reply).
+    // Every manager resets in constant time and the generation advances.
+    void clear();
+
+    unsigned int getGeneration() const { return generation; }
+    void setGeneration(unsigned int value) { generation = value; }
+
+    // Snapshot support for Checkpointer
+    bool save(RingFile& file);
+    bool load(RingFile& file);
+
+    // Splits "-k value" pairs; the strings live in the current command
+    // arena. Public so the microbenchmarks can measure it.
+    static void parseArgs(const char* args, char* keys[], char* values[], int& count);
+    static const char* getArgValue(char* keys[], char* values[], int count, const char* key);
+
+private:
+
+    void handleAddUser(const char* args, OutputBuffer& out);
+    void handleLogin(const char* args, OutputBuffer& out);
+    void handleLogout(const char* args, OutputBuffer& out);
+    void handleQueryProfile(const char* args, OutputBuffer& out);
+    void handleModifyProfile(const char* args, OutputBuffer& out);
+    void handleAddTrain(const char* args, OutputBuffer& out);
+    void handleReleaseTrain(const char* args, OutputBuffer& out);
+    void handleQueryTrain(const char* args, OutputBuffer& out);
+    void handleDeleteTrain(const char* args, OutputBuffer& out);
+    void handleQueryTicket(const char* args, OutputBuffer& out);
+    void handleQueryTransfer(const char* args, OutputBuffer& out);
+    void handleBuyTicket(const char* args, OutputBuffer& out);
+    void handleQueryOrder(const char* args, OutputBuffer& out);
+    void handleRefundTicket(const char* args, OutputBuffer& out);
+    void handleClean(OutputBuffer& out);
+    void handleExit(OutputBuffer& out);
+};
+
+#endif // TICKET_SYSTEM_H
@@ -0,0 +1,88 @@
+#include "trace.h"
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+
+namespace {
+
+struct Span {
+    const char* name;
+    unsigned long long begin, end;
+};
+
+struct Ring {
+    Span spans[Tracer::RING_SIZE];
+    unsigned long long written;  // total spans ever recorded
+    int threadId;
+};
+
+Ring* rings[Tracer::MAX_THREADS];
+std::atomic<int> ringCount(0);
+
+long long monotonicNanos() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Tick and clock readings from startup, for converting ticks to time
+const unsigned long long originTicks = traceTicks();
+const long long originNanos = monotonicNanos();
+
+Ring* localRing() {
+    thread_local Ring* ring = nullptr;
+    thread_local bool assigned = false;
+    if (!assigned) {
+        assigned = true;
+        // Threads beyond MAX_THREADS go untraced
+        int index = ringCount.fetch_add(1);
+        if (index < Tracer::MAX_THREADS) {
+            ring = new Ring();
+            ring->threadId = index;
+            rings[index] = ring;
+        }
+    }
+    return ring;
+}
+
+} // namespace
+
+void Tracer::record(const char* name, unsigned long long begin, unsigned long long end) {
+    Ring* ring = localRing();
+    if (!ring) return;
+    Span& span = ring->spans[ring->written % RING_SIZE];
+    span.name = name;
+    span.begin = begin;
+    span.end = end;
+    ring->written++;
+}
+
+bool Tracer::exportChromeJson(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) return false;
+
+    // Calibrate ticks against the monotonic clock over the whole run
+    unsigned long long elapsedTicks = traceTicks() - originTicks;
+    long long elapsedNanos = monotonicNanos() - originNanos;
+    double microsPerTick = elapsedTicks > 0 ? elapsedNanos / 1000.0 / elapsedTicks : 0.0;
+
+    fprintf(file, "{\"traceEvents\":[");
+    bool first = true;
+    int threads = ringCount.load();
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    for (int t = 0; t < threads; t++) {
+        Ring* ring = rings[t];
+        if (!ring) continue;
+        unsigned long long begin = ring->written > RING_SIZE ? ring->written - RING_SIZE : 0;
+        for (unsigned long long i = begin; i < ring->written; i++) {
+            const Span& span = ring->spans[i % RING_SIZE];
+            fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",", span.name, ring->threadId,
+                    (double)(span.begin - originTicks) * microsPerTick,
+                    (double)(span.end - span.begin) * microsPerTick);
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
@@ -0,0 +1,60 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Scoped tracing spans. Build with ENABLE_TRACE (cmake -DENABLE_TRACE=ON or
+// make TRACE=1) and TRACE_SCOPE("name") records the cycle counter at scope
+// entry and exit into a per-thread ring buffer; otherwise the macro
+// expands to nothing. Names must be string literals.
+//
+// Tracer::exportChromeJson writes the rings as Chrome trace JSON, which
+// chrome://tracing and Perfetto load directly.
+
+#ifdef ENABLE_TRACE
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline unsigned long long traceTicks() { return __rdtsc(); }
+#else
+#include <ctime>
+inline unsigned long long traceTicks() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+#endif
+
+class Tracer {
+public:
+    static const int RING_SIZE = 1 << 16;  // spans kept per thread, newest win
+    static const int MAX_THREADS = 64;
+
+    static void record(const char* name, unsigned long long begin, unsigned long long end);
+
+    // Only call while no traced code is running (e.g. on exit)
+    static bool exportChromeJson(const char* path);
+};
+
+class TraceScope {
+private:
+    const char* name;
+    unsigned long long begin;
+
+    TraceScope(const TraceScope&);
+    TraceScope& operator=(const TraceScope&);
+
+public:
+    explicit TraceScope(const char* spanName) : name(spanName), begin(traceTicks()) {}
+    ~TraceScope() { Tracer::record(name, begin, traceTicks()); }
+};
+
+#endif // TRACE_H
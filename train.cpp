@@ -1,121 +1,418 @@
 #include "train.h"
 #include "utils.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "arena.h"
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
 
-TrainManager::TrainManager() : trainCount(0) {}
+namespace {
 
-int TrainManager::addTrain(const char* trainID, int stationNum, int seatNum, const char* stations,
-                          const char* prices, const char* startTime, const char* travelTimes,
-                          const char* stopoverTimes, const char* saleDate, char type) {
-    // Check if train already exists
-    if (findTrain(trainID)) return -1;
+// A table with no released trains over a fresh trains array
+TrainTable* emptyTable() {
+    TrainTable* table = new TrainTable();
+    table->trains = new const Train*[MAX_TRAINS];
+    return table;
+}
+
+} // namespace
+
+TrainManager::TrainManager()
+    : trainCount(0), slotCount(0), freeCount(0), staleFilterKeys(0), trainIndex(MAX_TRAINS),
+      trainFilter(BloomFilter::MIN_KEYS), published(emptyTable()), retired(nullptr), draining(nullptr) {}
+
+TrainManager::~TrainManager() {
+    publish(nullptr, true);
+    reclaimSnapshots();
+    drainTrains(-1);
+}
+
+void TrainManager::publish(TrainTable* table, bool retireTrains) {
+    // Only the writer swaps tables, so the old one is still ours to retire
+    TrainTable* old = published.load(std::memory_order_relaxed);
+    published.store(table, std::memory_order_release);
+    old->ownsTrains = retireTrains;
+    old->retiredNext = retired;
+    retired = old;
+}
+
+void TrainManager::reclaimSnapshots() {
+    while (retired) {
+        TrainTable* table = retired;
+        retired = table->retiredNext;
+        // The last table before a clean has the largest count of its
+        // array; its train copies are freed a few per command
+        if (table->ownsTrains) {
+            table->retiredNext = draining;
+            draining = table;
+            continue;
+        }
+        delete[] table->ranks;
+        delete table;
+    }
+    drainTrains(RECLAIM_BATCH);
+}
+
+void TrainManager::drainTrains(int limit) {
+    while (draining && limit != 0) {
+        TrainTable* table = draining;
+        while (table->count > 0 && limit != 0) {
+            const Train* train = table->trains[--table->count];
+            delete[] train->seats;
+            delete train;
+            limit--;
+        }
+        if (table->count > 0) return;
+        draining = table->retiredNext;
+        delete[] table->trains;
+        delete[] table->ranks;
+        delete table;
+    }
+}
+
+int TrainManager::allocateSlot() {
+    while (freeCount > 0) {
+        int slot = freeSlots[--freeCount];
+        if (slot < slotCount) return slot;  // else compaction already trimmed it
+    }
+    return slotCount < MAX_TRAINS ? slotCount++ : -1;
+}
+
+void TrainManager::freeSlot(int slot) {
+    trains[slot].inUse = false;
+    trains[slot].isReleased = false;
+    freeSlots[freeCount++] = slot;
+}
+
+bool TrainManager::compactStep() {
+    while (slotCount > 0 && !trains[slotCount - 1].inUse) slotCount--;
+
+    while (freeCount > 0) {
+        int hole = freeSlots[--freeCount];
+        if (hole >= slotCount) continue;
 
-    if (trainCount >= MAX_TRAINS) return -1;
-    if (stationNum < 2 || stationNum > MAX_STATIONS) return -1;
-    if (seatNum <= 0 || seatNum > 100000) return -1;
+        // Move the last live record down and repoint its index entry. The
+        // station sets and the published table name released trains by
+        // serial, and the seat row moves with the pointer, so nothing else
+        // changes.
+        int from = slotCount - 1;
+        trains[hole] = trains[from];
+        trainIndex.update(trains[hole].trainID, hole);
+        trains[from].inUse = false;
+
+        while (slotCount > 0 && !trains[slotCount - 1].inUse) slotCount--;
+        return true;
+    }
+    return false;
+}
+
+bool TrainManager::parseTrain(const char* trainID, int stationNum, int seatNum, const char* stations,
+                              const char* prices, const char* startTime, const char* travelTimes,
+                              const char* stopoverTimes, const char* saleDate, char type, Train& newTrain) {
+    if (strlen(trainID) > (size_t)MAX_ID_LEN) return false;  // neither Train nor IdIndex can hold it
+    if (stationNum < 2 || stationNum > MAX_STATIONS) return false;
+    if (seatNum <= 0 || seatNum > 100000) return false;
+    if (stationNum == 2 && strcmp(stopoverTimes, "_") != 0) return false;
 
-    Train& newTrain = trains[trainCount++];
     strcpy(newTrain.trainID, trainID);
     newTrain.stationNum = stationNum;
     newTrain.seatNum = seatNum;
     newTrain.type = type;
     newTrain.isReleased = false;
+    newTrain.rank = -1;
+    newTrain.serial = -1;
+    newTrain.seats = nullptr;
+    char* save = nullptr;
+
+    // strtok_r needs writable copies of the lists
+    ArenaScope scope;
+    Arena& arena = Arena::current();
 
     // Parse stations
-    char* stationsCopy = new char[strlen(stations) + 1];
-    strcpy(stationsCopy, stations);
-    char* token = strtok(stationsCopy, "|");
+    char* stationsCopy = arena.copyString(stations);
+    char* token = strtok_r(stationsCopy, "|", &save);
     int stationIndex = 0;
     while (token != nullptr && stationIndex < stationNum) {
         strcpy(newTrain.stations[stationIndex], token);
-        token = strtok(nullptr, "|");
+        token = strtok_r(nullptr, "|", &save);
         stationIndex++;
     }
-    delete[] stationsCopy;
 
     // Parse prices
-    char* pricesCopy = new char[strlen(prices) + 1];
-    strcpy(pricesCopy, prices);
-    token = strtok(pricesCopy, "|");
+    char* pricesCopy = arena.copyString(prices);
+    token = strtok_r(pricesCopy, "|", &save);
     int priceIndex = 0;
     while (token != nullptr && priceIndex < stationNum - 1) {
         newTrain.prices[priceIndex] = parseInt(token);
-        token = strtok(nullptr, "|");
+        token = strtok_r(nullptr, "|", &save);
         priceIndex++;
     }
-    delete[] pricesCopy;
 
     // Parse start time
     newTrain.startTime = parseTime(startTime);
 
     // Parse travel times
-    char* travelCopy = new char[strlen(travelTimes) + 1];
-    strcpy(travelCopy, travelTimes);
-    token = strtok(travelCopy, "|");
+    char* travelCopy = arena.copyString(travelTimes);
+    token = strtok_r(travelCopy, "|", &save);
     int travelIndex = 0;
     while (token != nullptr && travelIndex < stationNum - 1) {
         newTrain.travelTimes[travelIndex] = parseInt(token);
-        token = strtok(nullptr, "|");
+        token = strtok_r(nullptr, "|", &save);
         travelIndex++;
     }
-    delete[] travelCopy;
 
     // Parse stopover times
     if (stationNum > 2) {
-        char* stopoverCopy = new char[strlen(stopoverTimes) + 1];
-        strcpy(stopoverCopy, stopoverTimes);
-        token = strtok(stopoverCopy, "|");
+        char* stopoverCopy = arena.copyString(stopoverTimes);
+        token = strtok_r(stopoverCopy, "|", &save);
         int stopoverIndex = 0;
         while (token != nullptr && stopoverIndex < stationNum - 2) {
             newTrain.stopoverTimes[stopoverIndex] = parseInt(token);
-            token = strtok(nullptr, "|");
+            token = strtok_r(nullptr, "|", &save);
             stopoverIndex++;
         }
-        delete[] stopoverCopy;
-    } else if (stationNum == 2) {
-        // For trains with 2 stations, stopoverTimes should be "_"
-        if (strcmp(stopoverTimes, "_") != 0) {
-            // Invalid input for 2-station train
-            trainCount--; // Rollback
-            return -1;
-        }
     }
 
     // Parse sale dates
-    char* saleCopy = new char[strlen(saleDate) + 1];
-    strcpy(saleCopy, saleDate);
-    token = strtok(saleCopy, "|");
+    char* saleCopy = arena.copyString(saleDate);
+    token = strtok_r(saleCopy, "|", &save);
     if (token) {
         newTrain.saleDate[0] = parseDate(token);
-        token = strtok(nullptr, "|");
+        token = strtok_r(nullptr, "|", &save);
         if (token) {
             newTrain.saleDate[1] = parseDate(token);
         }
     }
-    delete[] saleCopy;
 
-    // Initialize seat availability
-    for (int i = 0; i < stationNum - 1; i++) {
-        newTrain.availableSeats[i] = seatNum;
+    return true;
+}
+
+int TrainManager::addTrain(const char* trainID, int stationNum, int seatNum, const char* stations,
+                          const char* prices, const char* startTime, const char* travelTimes,
+                          const char* stopoverTimes, const char* saleDate, char type) {
+    // Check if train already exists
+    if (findTrain(trainID)) return -1;
+
+    int slot = allocateSlot();
+    if (slot == -1) return -1;
+
+    Train& newTrain = trains[slot];
+    if (!parseTrain(trainID, stationNum, seatNum, stations, prices, startTime, travelTimes,
+                    stopoverTimes, saleDate, type, newTrain)) {
+        freeSlot(slot);
+        return -1;
+    }
+    if (!trainIndex.insert(trainID, slot)) {
+        freeSlot(slot);
+        return -1;
     }
+    newTrain.inUse = true;
+    trainCount++;
+    trainFilter.insert(trainID);
+    if (trainFilter.size() > trainFilter.capacity()) rebuildTrainFilter();
 
     return 0;
 }
 
+namespace {
+
+// The immutable copy readers get once a train is released
+const Train* freezeTrain(const Train& train) {
+    Train* copy = new Train(train);
+    copy->rank = -1;  // ranks shift with later releases; TrainTable holds them
+    return copy;
+}
+
+// Stable merge sort of slot numbers by trainID; tmp holds n ints
+void sortSlotsByID(int* slots, int n, int* tmp, const Train* trains) {
+    for (int width = 1; width < n; width *= 2) {
+        for (int lo = 0; lo < n; lo += 2 * width) {
+            int mid = lo + width < n ? lo + width : n;
+            int hi = lo + 2 * width < n ? lo + 2 * width : n;
+            int i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                if (strcmp(trains[slots[j]].trainID, trains[slots[i]].trainID) < 0) {
+                    tmp[k++] = slots[j++];
+                } else {
+                    tmp[k++] = slots[i++];
+                }
+            }
+            while (i < mid) tmp[k++] = slots[i++];
+            while (j < hi) tmp[k++] = slots[j++];
+        }
+        memcpy(slots, tmp, sizeof(int) * n);
+    }
+}
+
+} // namespace
+
+void TrainManager::addParsedTrains(Train* staged, const bool* parsed, int count, int* results) {
+    TRACE_SCOPE("TrainManager::addParsedTrains");
+    ArenaScope scope;
+    Arena& arena = Arena::current();
+    int* order = arena.allocateArray<int>(count);
+    int* tmp = arena.allocateArray<int>(count > trainCount ? count : trainCount);
+    bool* accepted = arena.allocateArray<bool>(count);
+
+    // Sort the batch by ID (stable, so equal IDs stay in input order) and
+    // keep the first parsed occurrence of each ID not already stored
+    int valid = 0;
+    for (int i = 0; i < count; i++) {
+        accepted[i] = false;
+        if (parsed[i]) order[valid++] = i;
+    }
+    sortSlotsByID(order, valid, tmp, staged);
+    for (int i = 0; i < valid; i++) {
+        if (i > 0 && strcmp(staged[order[i]].trainID, staged[order[i - 1]].trainID) == 0) continue;
+        accepted[order[i]] = !findTrain(staged[order[i]].trainID);
+    }
+
+    // A rebuild costs a pass over every stored train, an insert about one
+    // page; runs that are small next to the store insert key by key
+    bool insertEach = (long long)count * IdIndex::PAGE_KEYS <= trainCount;
+
+    // Slots are handed out in input order, exactly as one-at-a-time adds would
+    int* newSlots = order;
+    int added = 0;
+    for (int i = 0; i < count; i++) {
+        int slot = accepted[i] ? allocateSlot() : -1;
+        if (slot != -1 && insertEach && !trainIndex.insert(staged[i].trainID, slot)) {
+            freeSlot(slot);
+            slot = -1;
+        }
+        if (slot != -1) {
+            trains[slot] = staged[i];
+            trains[slot].inUse = true;
+            trainFilter.insert(staged[i].trainID);
+            newSlots[added++] = slot;
+            results[i] = 0;
+        } else {
+            results[i] = -1;
+        }
+    }
+
+    // Extend the ID index bottom-up: sort the new slots, merge them with
+    // the existing sorted run in one pass, then repack the pages
+    int oldCount = trainCount;
+    trainCount += added;
+    if (trainFilter.size() > trainFilter.capacity()) rebuildTrainFilter();
+    if (added > 0 && !insertEach) {
+        sortSlotsByID(newSlots, added, tmp, trains);
+
+        int* existing = arena.allocateArray<int>(oldCount);
+        trainIndex.collect(existing);
+        int* merged = arena.allocateArray<int>(trainCount);
+        int i = 0, j = 0, k = 0;
+        while (i < oldCount && j < added) {
+            if (strcmp(trains[newSlots[j]].trainID, trains[existing[i]].trainID) < 0) {
+                merged[k++] = newSlots[j++];
+            } else {
+                merged[k++] = existing[i++];
+            }
+        }
+        while (i < oldCount) merged[k++] = existing[i++];
+        while (j < added) merged[k++] = newSlots[j++];
+        buildTrainIndex(merged, trainCount);
+    }
+}
+
 int TrainManager::releaseTrain(const char* trainID) {
+    TRACE_SCOPE("TrainManager::releaseTrain");
     Train* train = findTrain(trainID);
     if (!train) return -1;
     if (train->isReleased) return -1;
 
+    // The new table shares the trains array; the new serial lies past the
+    // count of every table a reader might hold
+    const TrainTable* current = published.load(std::memory_order_relaxed);
+    TrainTable* table = new TrainTable();
+    table->count = current->count + 1;
+    table->trains = current->trains;
+    table->ranks = new int[table->count];
+
+    // Keep ranks dense and in trainID order: the new train takes the rank
+    // after every released train with a smaller ID
+    int rank = 0;
+    for (int i = 0; i < slotCount; i++) {
+        if (!trains[i].isReleased) continue;
+        if (strcmp(trains[i].trainID, trainID) < 0) {
+            rank++;
+        } else {
+            trains[i].rank++;
+        }
+        table->ranks[trains[i].serial] = trains[i].rank;
+    }
+
+    train->rank = rank;
+    train->serial = current->count;
     train->isReleased = true;
+    train->seats = new int[train->stationNum - 1];
+    for (int i = 0; i < train->stationNum - 1; i++) train->seats[i] = train->seatNum;
+    indexStations(train - trains);
+
+    table->trains[train->serial] = freezeTrain(*train);
+    table->ranks[train->serial] = rank;
+    publish(table, false);
     return 0;
 }
 
+void TrainManager::indexStations(int slot) {
+    Train& train = trains[slot];
+    // Running price and minutes from the origin's departure; the terminus
+    // has no stopover, so it "leaves" when it arrives
+    int keys[ORDER_COUNT];
+#ifdef ENABLE_PAIR_INDEX
+    int prices[MAX_STATIONS], leaving[MAX_STATIONS], arriving[MAX_STATIONS];
+#endif
+    keys[ORDER_PRICE] = 0;
+    keys[ORDER_ARRIVING] = keys[ORDER_LEAVING] = train.startTime.hour * 60 + train.startTime.minute;
+    for (int i = 0; i < train.stationNum; i++) {
+        if (i > 0) {
+            keys[ORDER_PRICE] += train.prices[i - 1];
+            keys[ORDER_ARRIVING] = keys[ORDER_LEAVING] + train.travelTimes[i - 1];
+            keys[ORDER_LEAVING] = keys[ORDER_ARRIVING] + (i + 1 < train.stationNum ? train.stopoverTimes[i - 1] : 0);
+        }
+        train.stationIds[i] = stationIndex.intern(train.stations[i]);
+        stationIndex.add(train.stationIds[i], train.serial, keys);
+#ifdef ENABLE_PAIR_INDEX
+        prices[i] = keys[ORDER_PRICE];
+        leaving[i] = keys[ORDER_LEAVING];
+        arriving[i] = keys[ORDER_ARRIVING];
+#endif
+    }
+
+#ifdef ENABLE_PAIR_INDEX
+    // Every ordered pair of stops, skipping repeat visits so a pair maps
+    // to the stops getStationIndex would pick
+    bool firstVisit[MAX_STATIONS];
+    for (int i = 0; i < train.stationNum; i++) {
+        firstVisit[i] = true;
+        for (int j = 0; j < i && firstVisit[i]; j++) firstVisit[i] = train.stationIds[j] != train.stationIds[i];
+    }
+    PairIndex::Entry entry;
+    entry.serial = (unsigned short)train.serial;
+    for (int i = 0; i < train.stationNum; i++) {
+        if (!firstVisit[i]) continue;
+        for (int j = i + 1; j < train.stationNum; j++) {
+            if (!firstVisit[j]) continue;
+            entry.price = prices[j] - prices[i];
+            entry.leaving = leaving[i];
+            entry.duration = arriving[j] - leaving[i];
+            entry.fromIndex = (unsigned char)i;
+            entry.toIndex = (unsigned char)j;
+            pairIndex.insert(train.stationIds[i], train.stationIds[j], entry);
+        }
+    }
+#endif
+}
+
 int TrainManager::queryTrain(const char* trainID, const char* dateStr, char* result) {
-    Train* train = findTrain(trainID);
+    TRACE_SCOPE("TrainManager::queryTrain");
+    const Train* train = findTrain(trainID);
     if (!train) return -1;
+    // Released trains are read from their frozen copy
+    if (train->isReleased) train = snapshot()->trains[train->serial];
 
     Date queryDate = parseDate(dateStr);
     if (queryDate < train->saleDate[0] || queryDate > train->saleDate[1]) return -1;
@@ -179,7 +476,7 @@ int TrainManager::queryTrain(const char* trainID, const char* dateStr, char* res
             price += train->prices[j];
         }
 
-        int seats = (i < train->stationNum - 1) ? train->availableSeats[i] : 0;
+        int seats = i == train->stationNum - 1 ? 0 : train->seats ? train->seats[i] : train->seatNum;
 
         if (i == 0) {
             ptr += sprintf(ptr, "%s xx-xx xx:xx -> %02d-%02d %02d:%02d %d %d\n",
@@ -202,26 +499,54 @@ int TrainManager::queryTrain(const char* trainID, const char* dateStr, char* res
 }
 
 int TrainManager::deleteTrain(const char* trainID) {
+    TRACE_SCOPE("TrainManager::deleteTrain");
     Train* train = findTrain(trainID);
     if (!train) return -1;
     if (train->isReleased) return -1;
 
-    // Remove train by shifting array
-    int index = train - trains;
-    for (int i = index; i < trainCount - 1; i++) {
-        trains[i] = trains[i + 1];
-    }
+    // Drop its index entry and tombstone the slot; no other record moves
+    trainIndex.erase(trainID);
+    freeSlot(train - trains);
     trainCount--;
 
+    // Bloom filters cannot forget a key. A stale key only costs an index
+    // probe, so rebuild from the survivors once they make up a fair share.
+    staleFilterKeys++;
+    if (staleFilterKeys > trainCount / 4 + 16) {
+        rebuildTrainFilter();
+    }
+
     return 0;
 }
 
-Train* TrainManager::findTrain(const char* trainID) {
-    for (int i = 0; i < trainCount; i++) {
-        if (strcmp(trains[i].trainID, trainID) == 0) {
-            return &trains[i];
-        }
+void TrainManager::rebuildTrainFilter() {
+    // Room for the live trains to double before the next resize; a filter
+    // left four times too big by deletes shrinks back
+    if (trainFilter.capacity() < trainCount || trainFilter.capacity() > trainCount * 4) {
+        trainFilter.resize(trainCount * 2);
+    } else {
+        trainFilter.clear();
+    }
+    staleFilterKeys = 0;
+    for (int i = 0; i < slotCount; i++) {
+        if (trains[i].inUse) trainFilter.insert(trains[i].trainID);
     }
+}
+
+void TrainManager::buildTrainIndex(const int* slots, int n) {
+    ArenaScope scope;
+    const char** keys = Arena::current().allocateArray<const char*>(n);
+    for (int i = 0; i < n; i++) keys[i] = trains[slots[i]].trainID;
+    trainIndex.build(keys, slots, n);
+}
+
+Train* TrainManager::findTrain(const char* trainID) {
+    TRACE_SCOPE("TrainManager::findTrain");
+    if (!trainFilter.mightContain(trainID)) return nullptr;
+
+    int slot = trainIndex.find(trainID);
+    if (slot != -1) return &trains[slot];
+    // False positive, including IDs deleted since the last rebuild
     return nullptr;
 }
 
@@ -247,17 +572,33 @@ int TrainManager::calculatePrice(const Train* train, int fromIndex, int toIndex)
     return price;
 }
 
-int TrainManager::getMinAvailableSeats(Train* train, int fromIndex, int toIndex) {
-    int minSeats = train->availableSeats[fromIndex];
+std::mutex& TrainManager::seatLock(const Train* train) {
+    // FNV-1a over the trainID: stable even when delete_train moves slots
+    unsigned int h = 2166136261u;
+    for (const char* p = train->trainID; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    return seatLocks[h % SEAT_LOCK_STRIPES];
+}
+
+int TrainManager::minSeatsLocked(const Train* train, int fromIndex, int toIndex) {
+    if (!train->seats) return train->seatNum;
+    int minSeats = train->seats[fromIndex];
     for (int i = fromIndex + 1; i < toIndex; i++) {
-        if (train->availableSeats[i] < minSeats) {
-            minSeats = train->availableSeats[i];
+        if (train->seats[i] < minSeats) {
+            minSeats = train->seats[i];
         }
     }
     return minSeats;
 }
 
-int TrainManager::getAvailableSeats(Train* train, int fromIndex, int toIndex, const Date& date) {
+int TrainManager::getMinAvailableSeats(const Train* train, int fromIndex, int toIndex) {
+    std::lock_guard<std::mutex> guard(seatLock(train));
+    return minSeatsLocked(train, fromIndex, toIndex);
+}
+
+int TrainManager::getAvailableSeats(const Train* train, int fromIndex, int toIndex, const Date& date) {
     // Check if date is within sale range
     if (date < train->saleDate[0] || date > train->saleDate[1]) return 0;
 
@@ -265,43 +606,505 @@ int TrainManager::getAvailableSeats(Train* train, int fromIndex, int toIndex, co
 }
 
 bool TrainManager::updateSeats(Train* train, int fromIndex, int toIndex, int numTickets, bool buy) {
+    TRACE_SCOPE("TrainManager::updateSeats");
+    // Check and update under one stripe lock so a purchase takes every
+    // segment or none of them
+    std::lock_guard<std::mutex> guard(seatLock(train));
+
+    if (!train->seats) return false;  // not released
     if (buy) {
         // Check if enough seats are available
-        int minSeats = getMinAvailableSeats(train, fromIndex, toIndex);
+        int minSeats = minSeatsLocked(train, fromIndex, toIndex);
         if (minSeats < numTickets) return false;
 
         // Reduce available seats
         for (int i = fromIndex; i < toIndex; i++) {
-            train->availableSeats[i] -= numTickets;
+            train->seats[i] -= numTickets;
         }
     } else {
         // Refund - increase available seats
         for (int i = fromIndex; i < toIndex; i++) {
-            train->availableSeats[i] += numTickets;
+            train->seats[i] += numTickets;
         }
     }
     return true;
 }
 
+int TrainManager::getArrivingOffset(const Train* train, int stationIndex) {
+    int minutes = train->startTime.hour * 60 + train->startTime.minute;
+    for (int i = 0; i < stationIndex; i++) {
+        minutes += train->travelTimes[i];
+        if (i > 0) minutes += train->stopoverTimes[i - 1];
+    }
+    return minutes;
+}
+
+int TrainManager::getLeavingOffset(const Train* train, int stationIndex) {
+    if (stationIndex == 0) return train->startTime.hour * 60 + train->startTime.minute;
+    return getArrivingOffset(train, stationIndex) + train->stopoverTimes[stationIndex - 1];
+}
+
+bool TrainManager::evaluateTicketCandidate(const TrainTable* table, int serial, const char* fromStation,
+                                           const char* toStation, int queryDay, TicketCandidate& candidate) {
+    const Train* train = table->trains[serial];
+
+    int fromIndex = getStationIndex(train, fromStation);
+    if (fromIndex == -1) return false;
+    int toIndex = getStationIndex(train, toStation);
+    if (toIndex == -1 || fromIndex >= toIndex) return false;
+
+    // The query date is the day the train leaves fromStation; map it
+    // back to the day it left its origin to check the sale range
+    int leavingOffset = getLeavingOffset(train, fromIndex);
+    int startDay = queryDay - leavingOffset / MINUTES_PER_DAY;
+    if (startDay < dateToDay(train->saleDate[0]) || startDay > dateToDay(train->saleDate[1])) return false;
+
+    candidate.train = train;
+    candidate.serial = serial;
+    candidate.rank = table->ranks[serial];
+    candidate.fromIndex = fromIndex;
+    candidate.toIndex = toIndex;
+    candidate.startDay = startDay;
+    candidate.leaving = startDay * MINUTES_PER_DAY + leavingOffset;
+    candidate.arriving = startDay * MINUTES_PER_DAY + getArrivingOffset(train, toIndex);
+    candidate.price = calculatePrice(train, fromIndex, toIndex);
+    return true;
+}
+
+#ifndef ENABLE_PAIR_INDEX
+namespace {
+
+// Shared state for one parallel query_ticket scan. Each chunk writes its
+// hits into its own slice of candidates (same offsets as the train range),
+// so workers never share an output slot.
+struct TicketScan {
+    TrainManager* manager;
+    const TrainTable* table;
+    const char* fromStation;
+    const char* toStation;
+    int queryDay;
+    TicketCandidate* candidates;
+    int* chunkCounts;
+};
+
+void scanTicketRange(void* context, int begin, int end) {
+    TicketScan* scan = (TicketScan*)context;
+    int found = 0;
+    for (int i = begin; i < end; i++) {
+        if (scan->manager->evaluateTicketCandidate(scan->table, i, scan->fromStation, scan->toStation,
+                                                   scan->queryDay, scan->candidates[begin + found])) {
+            found++;
+        }
+    }
+    scan->chunkCounts[begin / PARALLEL_QUERY_GRAIN] = found;
+}
+
+} // namespace
+#endif
+
 int TrainManager::queryTicket(const char* fromStation, const char* toStation, const char* dateStr,
                                const char* priority, char* result) {
-    Date queryDate = parseDate(dateStr);
+    TRACE_SCOPE("TrainManager::queryTicket");
+    int queryDay = dateToDay(parseDate(dateStr));
+    bool byCost = strcmp(priority, "cost") == 0;
+    const TrainTable* table = snapshot();
+    int released = table->count;
+
+    // Released with the calling command's arena scope
+    Arena& arena = Arena::current();
+    TicketCandidate* candidates = arena.allocateArray<TicketCandidate>(released);
+    unsigned long long* keys = arena.allocateArray<unsigned long long>(released);
+    unsigned long long* sortBuffer = arena.allocateArray<unsigned long long>(released);
+    int count = 0;
+
+#ifdef ENABLE_PAIR_INDEX
+    {
+        TRACE_SCOPE("queryTicket.scan");
+        count = collectPairCandidates(table, fromStation, toStation, queryDay, candidates);
+    }
+#else
+    if (released >= PARALLEL_QUERY_THRESHOLD && ThreadPool::instance().workerCount() > 0) {
+        TRACE_SCOPE("queryTicket.scan");
+        int chunkCounts[(MAX_TRAINS + PARALLEL_QUERY_GRAIN - 1) / PARALLEL_QUERY_GRAIN];
+        TicketScan scan = {this, table, fromStation, toStation, queryDay, candidates, chunkCounts};
+        ThreadPool::instance().parallelFor(released, PARALLEL_QUERY_GRAIN, scanTicketRange, &scan);
+
+        // Merge the per-chunk slices into a dense prefix, keeping train order
+        for (int begin = 0; begin < released; begin += PARALLEL_QUERY_GRAIN) {
+            int found = chunkCounts[begin / PARALLEL_QUERY_GRAIN];
+            for (int j = 0; j < found; j++) {
+                candidates[count++] = candidates[begin + j];
+            }
+        }
+    } else {
+        TRACE_SCOPE("queryTicket.scan");
+        for (int i = 0; i < released; i++) {
+            if (evaluateTicketCandidate(table, i, fromStation, toStation, queryDay, candidates[count])) {
+                count++;
+            }
+        }
+    }
+#endif
+
+    {
+        TRACE_SCOPE("queryTicket.sort");
+        for (int i = 0; i < count; i++) {
+            const TicketCandidate& c = candidates[i];
+            // (primary key, trainID rank, candidate index) packed high to low
+            unsigned long long primary = byCost ? c.price : c.arriving - c.leaving;
+            keys[i] = (primary << 32) | ((unsigned long long)c.rank << 16) | i;
+        }
+
+        // Ranks are unique, so the candidate index bytes need not be sorted
+        radixSortKeys(keys, count, sortBuffer, 2);
+    }
+
+    // Seat reads and formatting
+    TRACE_SCOPE("queryTicket.format");
     char* ptr = result;
+    ptr += sprintf(ptr, "%d\n", count);
+    for (int i = 0; i < count; i++) {
+        ptr = formatTicket(ptr, candidates[keys[i] & 0xFFFF]);
+    }
+
+    return 0;
+}
+
+#ifdef ENABLE_PAIR_INDEX
+int TrainManager::collectPairCandidates(const TrainTable* table, const char* fromStation,
+                                        const char* toStation, int queryDay, TicketCandidate* candidates) {
+    int fromId = stationIndex.find(fromStation);
+    int toId = stationIndex.find(toStation);
+    if (fromId == -1 || toId == -1) return 0;
+
+    PairIndex::Entry* entries = Arena::current().allocateArray<PairIndex::Entry>(trainCount);
+    int n = pairIndex.collect(fromId, toId, entries);
     int count = 0;
+    for (int i = 0; i < n; i++) {
+        const PairIndex::Entry& e = entries[i];
+        const Train* train = table->trains[e.serial];
+        // Same sale-range check as evaluateTicketCandidate, on stored offsets
+        int startDay = queryDay - e.leaving / MINUTES_PER_DAY;
+        if (startDay < dateToDay(train->saleDate[0]) || startDay > dateToDay(train->saleDate[1])) continue;
 
-    // Simple implementation - just return 0 for now
-    ptr += sprintf(ptr, "0\n");
+        TicketCandidate& c = candidates[count++];
+        c.train = train;
+        c.serial = e.serial;
+        c.rank = table->ranks[e.serial];
+        c.fromIndex = e.fromIndex;
+        c.toIndex = e.toIndex;
+        c.startDay = startDay;
+        c.leaving = startDay * MINUTES_PER_DAY + e.leaving;
+        c.arriving = c.leaving + e.duration;
+        c.price = e.price;
+    }
+    return count;
+}
+#endif
+
+int TrainManager::queryTicketTop(const char* fromStation, const char* toStation, const char* dateStr,
+                                 const char* priority, int k, char* result) {
+    TRACE_SCOPE("TrainManager::queryTicketTop");
+    int queryDay = dateToDay(parseDate(dateStr));
+    bool byCost = strcmp(priority, "cost") == 0;
+
+    int fromId = stationIndex.find(fromStation);
+    int toId = stationIndex.find(toStation);
+    if (fromId == -1 || toId == -1 || fromId == toId) {
+        strcpy(result, "0\n");
+        return 0;
+    }
+
+    // A trip's sort key is its destination key minus its origin key, so
+    // walk the destination's ordering upward and the origin's downward
+    // (Fagin's threshold algorithm). A train seen in neither list yet has
+    // a key of at least toList[j] - fromList[i]; once the k-th best beats
+    // that, nothing unseen can enter the top k. Every match stops at both
+    // stations, so the scan also ends when either list runs out.
+    const RankedTrain* fromList = stationIndex.ordering(fromId, byCost ? ORDER_PRICE : ORDER_LEAVING);
+    const RankedTrain* toList = stationIndex.ordering(toId, byCost ? ORDER_PRICE : ORDER_ARRIVING);
+    int i = stationIndex.trainCount(fromId) - 1;
+    int j = 0;
+    int toCount = stationIndex.trainCount(toId);
+    const TrainTable* table = snapshot();
+
+    // Released with the calling command's arena scope
+    Arena& arena = Arena::current();
+    if (k > trainCount) k = trainCount;
+    TicketCandidate* best = arena.allocateArray<TicketCandidate>(k);
+    unsigned long long* keys = arena.allocateArray<unsigned long long>(k);  // (primary, rank), ascending
+    TrainSet* seen = arena.allocateArray<TrainSet>(1);
+    seen->clear();
+    int found = 0;
 
+    {
+        TRACE_SCOPE("queryTicketTop.scan");
+        while (i >= 0 && j < toCount && k > 0) {
+            int picks[2] = {fromList[i--].serial, toList[j++].serial};
+            for (int p = 0; p < 2; p++) {
+                int serial = picks[p];
+                if (seen->test(serial)) continue;
+                seen->set(serial);
+
+                TicketCandidate c;
+                if (!evaluateTicketCandidate(table, serial, fromStation, toStation, queryDay, c)) continue;
+                unsigned long long primary = byCost ? c.price : c.arriving - c.leaving;
+                unsigned long long key = (primary << 32) | (unsigned long long)c.rank;
+                if (found == k && key >= keys[k - 1]) continue;
+
+                int pos = found < k ? found++ : k - 1;
+                while (pos > 0 && keys[pos - 1] > key) {
+                    keys[pos] = keys[pos - 1];
+                    best[pos] = best[pos - 1];
+                    pos--;
+                }
+                keys[pos] = key;
+                best[pos] = c;
+            }
+
+            // An unseen train tying the bound could still win on trainID
+            if (found == k && i >= 0 && j < toCount &&
+                (long long)(keys[k - 1] >> 32) < (long long)toList[j].key - fromList[i].key) break;
+        }
+    }
+
+    // Seats are read for the winners only
+    TRACE_SCOPE("queryTicketTop.format");
+    char* ptr = result;
+    ptr += sprintf(ptr, "%d\n", found);
+    for (int n = 0; n < found; n++) {
+        ptr = formatTicket(ptr, best[n]);
+    }
     return 0;
 }
 
+char* TrainManager::formatTicket(char* ptr, const TicketCandidate& c) {
+    int seats = getAvailableSeats(c.train, c.fromIndex, c.toIndex, dayToDate(c.startDay));
+    ptr += sprintf(ptr, "%s %s ", c.train->trainID, c.train->stations[c.fromIndex]);
+    ptr += formatDateTime(ptr, c.leaving);
+    ptr += sprintf(ptr, " -> %s ", c.train->stations[c.toIndex]);
+    ptr += formatDateTime(ptr, c.arriving);
+    ptr += sprintf(ptr, " %d %d\n", c.price, seats);
+    return ptr;
+}
+
+namespace {
+
+int stationPosition(const Train* train, int station, int end) {
+    for (int i = 0; i < end; i++) {
+        if (train->stationIds[i] == station) return i;
+    }
+    return -1;
+}
+
+// Ordering of two transfer plans: time (or cost) first, then less riding
+// time on train 1 as the README asks for ties, then the first and second
+// trainIDs
+bool betterTransfer(const TicketCandidate& first, const TicketCandidate& second,
+                    const TicketCandidate& bestFirst, const TicketCandidate& bestSecond, bool byCost) {
+    int primary = byCost ? first.price + second.price : second.arriving - first.leaving;
+    int bestPrimary = byCost ? bestFirst.price + bestSecond.price : bestSecond.arriving - bestFirst.leaving;
+    if (primary != bestPrimary) return primary < bestPrimary;
+    int ride = first.arriving - first.leaving, bestRide = bestFirst.arriving - bestFirst.leaving;
+    if (ride != bestRide) return ride < bestRide;
+    if (first.rank != bestFirst.rank) return first.rank < bestFirst.rank;
+    return second.rank < bestSecond.rank;
+}
+
+} // namespace
+
 int TrainManager::queryTransfer(const char* fromStation, const char* toStation, const char* dateStr,
                                const char* priority, char* result) {
-    // Simple implementation - return 0 (no transfer found)
-    sprintf(result, "0");
+    TRACE_SCOPE("TrainManager::queryTransfer");
+    int fromId = stationIndex.find(fromStation);
+    int toId = stationIndex.find(toStation);
+    if (fromId == -1 || toId == -1 || fromId == toId) {
+        sprintf(result, "0\n");
+        return 0;
+    }
+    int queryDay = dateToDay(parseDate(dateStr));
+    bool byCost = strcmp(priority, "cost") == 0;
+
+    const TrainTable* table = snapshot();
+    TrainSet origin, destination, reach, meet, candidates;
+    stationIndex.expand(fromId, origin);
+    stationIndex.expand(toId, destination);
+
+    // Where each train into the destination stops there, and when
+    Arena& arena = Arena::current();
+    int* toIndexOf = arena.allocateArray<int>(table->count);
+    int* arrivingOffsetOf = arena.allocateArray<int>(table->count);
+    for (int w = 0; w < TRAIN_SET_WORDS; w++) {
+        for (unsigned long long bits = destination.words[w]; bits; bits &= bits - 1) {
+            int serial = w * 64 + __builtin_ctzll(bits);
+            const Train* train = table->trains[serial];
+            toIndexOf[serial] = stationPosition(train, toId, train->stationNum);
+            arrivingOffsetOf[serial] = getArrivingOffset(train, toIndexOf[serial]);
+        }
+    }
+
+    bool found = false;
+    TicketCandidate bestFirst, bestSecond;
+    for (int w = 0; w < TRAIN_SET_WORDS; w++) {
+        for (unsigned long long bits = origin.words[w]; bits; bits &= bits - 1) {
+            int serial1 = w * 64 + __builtin_ctzll(bits);
+            const Train* train1 = table->trains[serial1];
+            int fromIndex = stationPosition(train1, fromId, train1->stationNum);
+            if (fromIndex == train1->stationNum - 1) continue;
+
+            int leavingOffset = getLeavingOffset(train1, fromIndex);
+            int startDay = queryDay - leavingOffset / MINUTES_PER_DAY;
+            if (startDay < dateToDay(train1->saleDate[0]) || startDay > dateToDay(train1->saleDate[1])) continue;
+
+            // Prune before any time arithmetic: a second train must stop
+            // somewhere after fromStation on this train and at toStation
+            reach.clear();
+            for (int k = fromIndex + 1; k < train1->stationNum; k++) {
+                stationIndex.addTo(train1->stationIds[k], reach);
+            }
+            reach.reset(serial1);
+            if (intersectTrainSets(reach, destination, meet) == 0) continue;
+
+            TicketCandidate first;
+            first.train = train1;
+            first.serial = serial1;
+            first.rank = table->ranks[serial1];
+            first.fromIndex = fromIndex;
+            first.startDay = startDay;
+            first.leaving = startDay * MINUTES_PER_DAY + leavingOffset;
+            first.price = 0;
+            int offset = leavingOffset;
+            for (int k = fromIndex + 1; k < train1->stationNum; k++) {
+                offset += train1->travelTimes[k - 1];
+                first.price += train1->prices[k - 1];
+                first.toIndex = k;
+                first.arriving = startDay * MINUTES_PER_DAY + offset;
+                if (k < train1->stationNum - 1) offset += train1->stopoverTimes[k - 1];
+
+                int transfer = train1->stationIds[k];
+                if (transfer == toId) continue;
+                stationIndex.expand(transfer, candidates);
+                if (intersectTrainSets(candidates, meet, candidates) == 0) continue;
+
+                for (int v = 0; v < TRAIN_SET_WORDS; v++) {
+                    for (unsigned long long hits = candidates.words[v]; hits; hits &= hits - 1) {
+                        int serial2 = v * 64 + __builtin_ctzll(hits);
+                        const Train* train2 = table->trains[serial2];
+                        int toIndex = toIndexOf[serial2];
+                        int transferIndex = stationPosition(train2, transfer, toIndex);
+                        if (transferIndex == -1) continue;
+
+                        // Earliest run of train2 leaving the transfer station
+                        // no sooner than train1 gets there
+                        int leaving2 = getLeavingOffset(train2, transferIndex);
+                        int wait = first.arriving - leaving2;
+                        int startDay2 = wait <= 0 ? -(-wait / MINUTES_PER_DAY)
+                                                  : (wait + MINUTES_PER_DAY - 1) / MINUTES_PER_DAY;
+                        int firstSale = dateToDay(train2->saleDate[0]);
+                        if (startDay2 < firstSale) startDay2 = firstSale;
+                        if (startDay2 > dateToDay(train2->saleDate[1])) continue;
+
+                        TicketCandidate second;
+                        second.train = train2;
+                        second.serial = serial2;
+                        second.rank = table->ranks[serial2];
+                        second.fromIndex = transferIndex;
+                        second.toIndex = toIndex;
+                        second.startDay = startDay2;
+                        second.leaving = startDay2 * MINUTES_PER_DAY + leaving2;
+                        second.arriving = startDay2 * MINUTES_PER_DAY + arrivingOffsetOf[serial2];
+                        second.price = calculatePrice(train2, transferIndex, toIndex);
+
+                        if (!found || betterTransfer(first, second, bestFirst, bestSecond, byCost)) {
+                            found = true;
+                            bestFirst = first;
+                            bestSecond = second;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (!found) {
+        sprintf(result, "0\n");
+        return 0;
+    }
+    char* ptr = formatTicket(result, bestFirst);
+    formatTicket(ptr, bestSecond);
     return 0;
 }
 
 void TrainManager::clean() {
     trainCount = 0;
-}
\ No newline at end of file
+    slotCount = 0;
+    freeCount = 0;
+    staleFilterKeys = 0;
+    trainIndex.clear();
+    stationIndex.clear();
+#ifdef ENABLE_PAIR_INDEX
+    pairIndex.clear();
+#endif
+    trainFilter.clear();
+    // Readers may still hold the old table; its trains go at the next reclaim
+    publish(emptyTable(), true);
+}
+
+bool TrainManager::save(RingFile& file) {
+    // Live records only, so the snapshot stays dense whatever the holes;
+    // each released train is followed by its seat row
+    if (!file.write(&trainCount, sizeof(trainCount))) return false;
+    for (int i = 0; i < slotCount; i++) {
+        if (!trains[i].inUse) continue;
+        if (!file.write(&trains[i], sizeof(Train))) return false;
+        if (trains[i].isReleased &&
+            !file.write(trains[i].seats, (long long)sizeof(int) * (trains[i].stationNum - 1))) return false;
+    }
+    return true;
+}
+
+bool TrainManager::load(RingFile& file) {
+    clean();
+    int count;
+    if (!file.read(&count, sizeof(count)) || count < 0 || count > MAX_TRAINS) return false;
+    int loaded = 0;
+    bool ok = true;
+    while (ok && loaded < count) {
+        Train& train = trains[loaded++];
+        ok = file.read(&train, sizeof(Train)) && train.stationNum >= 2 && train.stationNum <= MAX_STATIONS;
+        train.seats = nullptr;  // the stored pointer is from another process
+        if (ok && train.isReleased) {
+            train.seats = new int[train.stationNum - 1];
+            ok = file.read(train.seats, (long long)sizeof(int) * (train.stationNum - 1));
+        }
+    }
+    if (!ok) {
+        for (int i = 0; i < loaded; i++) delete[] trains[i].seats;
+        return false;
+    }
+
+    trainCount = slotCount = count;
+    rebuildTrainFilter();
+
+    // Serials are handed out again in slot order; ranks are as stored
+    TrainTable* table = new TrainTable();
+    table->trains = published.load(std::memory_order_relaxed)->trains;
+    table->ranks = new int[trainCount > 0 ? trainCount : 1];
+    for (int i = 0; i < trainCount; i++) {
+        trains[i].serial = -1;
+        if (!trains[i].isReleased) continue;
+        trains[i].serial = table->count++;
+        indexStations(i);
+        table->trains[trains[i].serial] = freezeTrain(trains[i]);
+        table->ranks[trains[i].serial] = trains[i].rank;
+    }
+    publish(table, false);
+
+    ArenaScope scope;
+    int* slots = Arena::current().allocateArray<int>(trainCount);
+    int* tmp = Arena::current().allocateArray<int>(trainCount);
+    for (int i = 0; i < trainCount; i++) slots[i] = i;
+    sortSlotsByID(slots, trainCount, tmp, trains);
+    buildTrainIndex(slots, trainCount);
+    return true;
+}
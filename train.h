@@ -2,6 +2,15 @@
 #define TRAIN_H
 
 #include "utils.h"
+#include "ring_file.h"
+#include "bloom.h"
+#include "id_index.h"
+#include "station_index.h"
+#ifdef ENABLE_PAIR_INDEX
+#include "pair_index.h"
+#endif
+#include <atomic>
+#include <mutex>
 
 struct Train {
     char trainID[21];
@@ -15,14 +24,19 @@ struct Train {
     Date saleDate[2];                 // start and end sale dates
     char type;
     bool isReleased;
-    int availableSeats[MAX_STATIONS - 1]; // available seats between stations for each day
+    bool inUse;                       // false for free slots (tombstones)
+    int rank;                         // dense trainID order among released trains, -1 before release
+    int serial;                       // release order, the train's TrainTable index; -1 before release
+    int stationIds[MAX_STATIONS];     // interned station ids, set on release
+    int* seats;                       // available seats per segment; allocated on release, shared
+                                      // with the published copy (unreleased trains have seatNum)
 
-    Train() : stationNum(0), seatNum(0), type(' '), isReleased(false) {
+    Train() : stationNum(0), seatNum(0), type(' '), isReleased(false), inUse(false), rank(-1), serial(-1),
+              seats(nullptr) {
         trainID[0] = '\0';
         for (int i = 0; i < MAX_STATIONS - 1; i++) {
             prices[i] = 0;
             travelTimes[i] = 0;
-            availableSeats[i] = 0;
         }
         for (int i = 0; i < MAX_STATIONS - 2; i++) {
             stopoverTimes[i] = 0;
@@ -41,35 +55,146 @@ struct TicketInfo {
     int availableSeats;
 };
 
+// The released trains as query_ticket, query_train and query_transfer see
+// them, indexed by serial. Entries are frozen copies of each train taken
+// at release, sharing only the seat row with the writer's record.
+// Serials never move, so compaction leaves the table alone. release_train
+// publishes a new table that shares the trains array, appending past
+// every earlier table's count, and carries its own ranks, since every
+// release shifts the ranks of later trainIDs. clean publishes an empty
+// table over a fresh array.
+struct TrainTable {
+    int count;             // released trains: serials [0, count)
+    const Train** trains;  // shared by every table since the last clean
+    int* ranks;            // count entries, this table's own
+    // Writer bookkeeping once retired
+    bool ownsTrains;       // retired by clean: frees the copies, seat rows and array over later reclaims
+    TrainTable* retiredNext;
+
+    TrainTable() : count(0), trains(nullptr), ranks(nullptr), ownsTrains(false), retiredNext(nullptr) {}
+};
+
+// A train that serves a query_ticket station pair on the requested day
+struct TicketCandidate {
+    const Train* train;
+    int serial;
+    int rank;
+    int fromIndex, toIndex;
+    int startDay;  // day the train leaves its origin
+    int leaving;   // absolute minutes since the start of the year
+    int arriving;
+    int price;
+};
+
+// Seat rows are guarded by lock stripes chosen by trainID hash, so
+// purchases on different trains rarely contend
+const int SEAT_LOCK_STRIPES = 64;
+
+// Above this many stored trains, query_ticket evaluates candidates on the thread pool
+const int PARALLEL_QUERY_THRESHOLD = 256;
+const int PARALLEL_QUERY_GRAIN = 64;
+
+// Train copies a cleaned table gives back per reclaimSnapshots call; a
+// command releases at most one train, so the backlog always shrinks
+const int RECLAIM_BATCH = 8;
+
 class TrainManager {
 private:
+    // Train records live in slots. Deleting tombstones a slot and pushes
+    // it on the free list; compactStep later moves the last live record
+    // into a hole so [0, slotCount) stays dense under add/delete churn.
     Train trains[MAX_TRAINS];
-    int trainCount;
+    int trainCount;              // live trains
+    int slotCount;               // slots [0, slotCount) have been handed out
+    int freeSlots[MAX_TRAINS];   // tombstoned slots, possibly above slotCount
+    int freeCount;
+    int staleFilterKeys;         // deleted IDs still set in trainFilter
+    IdIndex trainIndex;          // trainID -> slot, live trains only
+    StationIndex stationIndex;   // station -> released trains stopping there
+#ifdef ENABLE_PAIR_INDEX
+    PairIndex pairIndex;         // (from, to) -> released trains running that way
+#endif
+    BloomFilter trainFilter;  // trainIDs of all stored trains
+    std::mutex seatLocks[SEAT_LOCK_STRIPES];
+    std::atomic<TrainTable*> published;  // what readers see; swapped by the writer
+    TrainTable* retired;                 // replaced tables awaiting reclaimSnapshots
+    TrainTable* draining;                // retired by clean, train copies still being freed
+
+    void rebuildTrainFilter();  // also resizes it to the live train count
+    void indexStations(int slot);  // adds a released train to stationIndex (and pairIndex)
+#ifdef ENABLE_PAIR_INDEX
+    // query_ticket's scan as one pairIndex range; returns the candidate count
+    int collectPairCandidates(const TrainTable* table, const char* fromStation, const char* toStation,
+                              int queryDay, TicketCandidate* candidates);
+#endif
+    int allocateSlot();          // -1 when full
+    void freeSlot(int slot);
+    void buildTrainIndex(const int* slots, int n);  // slots sorted by trainID
+    void publish(TrainTable* table, bool retireTrains);
+    void drainTrains(int limit);  // frees up to limit train copies of cleaned tables; -1 for all
+    std::mutex& seatLock(const Train* train);
+    int minSeatsLocked(const Train* train, int fromIndex, int toIndex);
+    // Appends one query_ticket style line for c; returns the new end
+    char* formatTicket(char* ptr, const TicketCandidate& c);
 
 public:
     TrainManager();
+    ~TrainManager();
 
     int addTrain(const char* trainID, int stationNum, int seatNum, const char* stations,
                  const char* prices, const char* startTime, const char* travelTimes,
                  const char* stopoverTimes, const char* saleDate, char type);
+    // Parses and validates one add_train into a staging record; thread-safe
+    bool parseTrain(const char* trainID, int stationNum, int seatNum, const char* stations,
+                    const char* prices, const char* startTime, const char* travelTimes,
+                    const char* stopoverTimes, const char* saleDate, char type, Train& train);
+    // Commits a run of parsed add_train commands in input order; results[i]
+    // is what addTrain would have returned for command i
+    void addParsedTrains(Train* staged, const bool* parsed, int count, int* results);
     int releaseTrain(const char* trainID);
     int queryTrain(const char* trainID, const char* date, char* result);
     int deleteTrain(const char* trainID);
     int queryTicket(const char* fromStation, const char* toStation, const char* date,
                     const char* priority, char* result);
+    // The best k trains of queryTicket; the first line counts only those
+    int queryTicketTop(const char* fromStation, const char* toStation, const char* date,
+                       const char* priority, int k, char* result);
     int queryTransfer(const char* fromStation, const char* toStation, const char* date,
                       const char* priority, char* result);
 
+    // Readers take the table once per command; it stays valid until the
+    // writer's next reclaimSnapshots. Readers run only between writer
+    // commands (read-only batches never overlap a mutation), which is
+    // what lets them consult stationIndex and pairIndex unlocked too.
+    const TrainTable* snapshot() const { return published.load(std::memory_order_acquire); }
+    // Frees retired tables, and at most RECLAIM_BATCH train copies left by
+    // a clean, so clean stays constant time. Call between commands, when
+    // no reader runs.
+    void reclaimSnapshots();
+
     Train* findTrain(const char* trainID);
+    void prefetchTrain(const char* trainID) const { trainIndex.prefetch(trainID); }
     bool isTrainReleased(const char* trainID);
     int getStationIndex(const Train* train, const char* station);
     int calculatePrice(const Train* train, int fromIndex, int toIndex);
     Time calculateArrivalTime(const Train* train, int stationIndex, const Date& departureDate);
-    int getAvailableSeats(Train* train, int fromIndex, int toIndex, const Date& date);
+    int getLeavingOffset(const Train* train, int stationIndex);
+    int getArrivingOffset(const Train* train, int stationIndex);
+    int getAvailableSeats(const Train* train, int fromIndex, int toIndex, const Date& date);
     bool updateSeats(Train* train, int fromIndex, int toIndex, int numTickets, bool buy);
-    int getMinAvailableSeats(Train* train, int fromIndex, int toIndex);
+    int getMinAvailableSeats(const Train* train, int fromIndex, int toIndex);
+    bool evaluateTicketCandidate(const TrainTable* table, int serial, const char* fromStation,
+                                 const char* toStation, int queryDay, TicketCandidate& candidate);
+
+    // Relocates at most one record to close a hole; returns false once
+    // the slots are dense. Call between commands.
+    bool compactStep();
 
     void clean();
+
+    // Snapshot support: raw records, indexes are rebuilt on load
+    bool save(RingFile& file);
+    bool load(RingFile& file);
 };
 
 #endif // TRAIN_H
\ No newline at end of file
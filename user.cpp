@@ -1,24 +1,30 @@
 #include "user.h"
+#include "trace.h"
 #include <cstring>
 #include <cstdio>
 #include <cctype>
 
-UserManager::UserManager() : userCount(0), firstUserAdded(false) {}
+UserManager::UserManager()
+    : userCount(0), firstUserAdded(false), userIndex(MAX_USERS), userFilter(BloomFilter::MIN_KEYS) {}
 
 int UserManager::addUser(const char* curUsername, const char* username, const char* password,
                         const char* name, const char* mailAddr, int privilege) {
+    TRACE_SCOPE("UserManager::addUser");
     // Check if first user
     if (!firstUserAdded) {
         // First user - special case
         if (userCount >= MAX_USERS) return -1;
 
-        User& newUser = users[userCount++];
+        User& newUser = users[userCount];
         strcpy(newUser.username, username);
         strcpy(newUser.password, password);
         strcpy(newUser.name, name);
         strcpy(newUser.mailAddr, mailAddr);
         newUser.privilege = 10;
         newUser.isLoggedIn = false;
+        userIndex.insert(username, userCount++);
+        userFilter.insert(username);
+        if (userFilter.size() > userFilter.capacity()) rebuildUserFilter();
 
         firstUserAdded = true;
         return 0;
@@ -39,18 +45,22 @@ int UserManager::addUser(const char* curUsername, const char* username, const ch
         !isValidName(name) || !isValidEmail(mailAddr)) return -1;
     if (privilege < 0 || privilege > 10) return -1;
 
-    User& newUser = users[userCount++];
+    User& newUser = users[userCount];
     strcpy(newUser.username, username);
     strcpy(newUser.password, password);
     strcpy(newUser.name, name);
     strcpy(newUser.mailAddr, mailAddr);
     newUser.privilege = privilege;
     newUser.isLoggedIn = false;
+    userIndex.insert(username, userCount++);
+    userFilter.insert(username);
+    if (userFilter.size() > userFilter.capacity()) rebuildUserFilter();
 
     return 0;
 }
 
 int UserManager::login(const char* username, const char* password) {
+    TRACE_SCOPE("UserManager::login");
     User* user = findUser(username);
     if (!user) return -1;
     if (user->isLoggedIn) return -1;
@@ -61,6 +71,7 @@ int UserManager::login(const char* username, const char* password) {
 }
 
 int UserManager::logout(const char* username) {
+    TRACE_SCOPE("UserManager::logout");
     User* user = findUser(username);
     if (!user) return -1;
     if (!user->isLoggedIn) return -1;
@@ -70,6 +81,7 @@ int UserManager::logout(const char* username) {
 }
 
 int UserManager::queryProfile(const char* curUsername, const char* username, char* result) {
+    TRACE_SCOPE("UserManager::queryProfile");
     User* curUser = findUser(curUsername);
     if (!curUser || !curUser->isLoggedIn) return -1;
 
@@ -85,6 +97,7 @@ int UserManager::queryProfile(const char* curUsername, const char* username, cha
 
 int UserManager::modifyProfile(const char* curUsername, const char* username, const char* password,
                               const char* name, const char* mailAddr, int privilege, char* result) {
+    TRACE_SCOPE("UserManager::modifyProfile");
     User* curUser = findUser(curUsername);
     if (!curUser || !curUser->isLoggedIn) return -1;
 
@@ -116,11 +129,13 @@ int UserManager::modifyProfile(const char* curUsername, const char* username, co
 }
 
 User* UserManager::findUser(const char* username) {
-    for (int i = 0; i < userCount; i++) {
-        if (strcmp(users[i].username, username) == 0) {
-            return &users[i];
-        }
-    }
+    TRACE_SCOPE("UserManager::findUser");
+    if (!username) return nullptr;
+    if (!userFilter.mightContain(username)) return nullptr;
+
+    int slot = userIndex.find(username);
+    if (slot != -1) return &users[slot];
+    // False positive: the index probe the filter was meant to save
     return nullptr;
 }
 
@@ -137,4 +152,36 @@ int UserManager::getUserPrivilege(const char* username) {
 void UserManager::clean() {
     userCount = 0;
     firstUserAdded = false;
-}
\ No newline at end of file
+    userIndex.clear();
+    userFilter.clear();
+}
+
+void UserManager::rebuildUserFilter() {
+    userFilter.resize(userCount * 2);
+    for (int i = 0; i < userCount; i++) {
+        userFilter.insert(users[i].username);
+    }
+}
+
+bool UserManager::save(RingFile& file) {
+    return file.write(&userCount, sizeof(userCount)) &&
+           file.write(&firstUserAdded, sizeof(firstUserAdded)) &&
+           file.write(users, (long long)sizeof(User) * userCount);
+}
+
+bool UserManager::load(RingFile& file) {
+    clean();
+    int count;
+    if (!file.read(&count, sizeof(count)) || count < 0 || count > MAX_USERS) return false;
+    if (!file.read(&firstUserAdded, sizeof(firstUserAdded)) ||
+        !file.read(users, (long long)sizeof(User) * count)) return false;
+
+    // Sessions do not survive a restart
+    userCount = count;
+    for (int i = 0; i < userCount; i++) {
+        users[i].isLoggedIn = false;
+        userIndex.insert(users[i].username, i);
+    }
+    rebuildUserFilter();
+    return true;
+}
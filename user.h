@@ -2,6 +2,9 @@
 #define USER_H
 
 #include "utils.h"
+#include "ring_file.h"
+#include "bloom.h"
+#include "id_index.h"
 
 struct User {
     char username[21];
@@ -24,6 +27,10 @@ private:
     User users[MAX_USERS];
     int userCount;
     bool firstUserAdded;
+    IdIndex userIndex;       // username -> slot in users
+    BloomFilter userFilter;  // usernames of all stored users
+
+    void rebuildUserFilter();  // resized to twice the user count
 
 public:
     UserManager();
@@ -37,11 +44,16 @@ public:
                       const char* name, const char* mailAddr, int privilege, char* result);
 
     User* findUser(const char* username);
+    void prefetchUser(const char* username) const { userIndex.prefetch(username); }
     bool isUserLoggedIn(const char* username);
     int getUserPrivilege(const char* username);
     bool isFirstUserAdded() { return firstUserAdded; }
 
     void clean();
+
+    // Snapshot support: raw records, indexes are rebuilt on load
+    bool save(RingFile& file);
+    bool load(RingFile& file);
 };
 
 #endif // USER_H
\ No newline at end of file
@@ -1,3 +1,73 @@
 #include "utils.h"
+#include <cstdarg>
 
-// Implementation of utility functions if needed
\ No newline at end of file
+void radixSortKeys(unsigned long long* keys, int n, unsigned long long* tmp, int lowByte) {
+    if (n < 2) return;
+
+    unsigned long long* src = keys;
+    unsigned long long* dst = tmp;
+    int counts[256];
+
+    for (int byte = lowByte; byte < 8; byte++) {
+        int shift = byte * 8;
+        for (int i = 0; i < 256; i++) counts[i] = 0;
+        for (int i = 0; i < n; i++) counts[(src[i] >> shift) & 0xFF]++;
+
+        // Skip passes where every key shares the same digit
+        if (counts[(src[0] >> shift) & 0xFF] == n) continue;
+
+        int offset = 0;
+        for (int i = 0; i < 256; i++) {
+            int c = counts[i];
+            counts[i] = offset;
+            offset += c;
+        }
+        for (int i = 0; i < n; i++) {
+            dst[counts[(src[i] >> shift) & 0xFF]++] = src[i];
+        }
+
+        unsigned long long* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != keys) {
+        memcpy(keys, src, sizeof(unsigned long long) * n);
+    }
+}
+
+void OutputBuffer::reserve(int needed) {
+    if (needed <= capacity) return;
+    int newCapacity = capacity ? capacity : 256;
+    while (newCapacity < needed) newCapacity *= 2;
+    char* newBuffer = new char[newCapacity];
+    if (length) memcpy(newBuffer, buffer, length);
+    delete[] buffer;
+    buffer = newBuffer;
+    capacity = newCapacity;
+}
+
+void OutputBuffer::append(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list retry;
+    va_copy(retry, args);
+
+    int room = capacity - length;
+    int written = vsnprintf(room > 0 ? buffer + length : nullptr, room > 0 ? room : 0, format, args);
+    va_end(args);
+
+    if (written >= room) {
+        reserve(length + written + 1);
+        vsnprintf(buffer + length, capacity - length, format, retry);
+    }
+    va_end(retry);
+    length += written;
+}
+
+void OutputBuffer::write(const char* data, int n) {
+    reserve(length + n + 1);
+    memcpy(buffer + length, data, n);
+    length += n;
+    buffer[length] = '\0';
+}
@@ -12,6 +12,7 @@ const int MAX_USERS = 1000;
 const int MAX_TRAINS = 1000;
 const int MAX_ORDERS = 10000;
 const int MAX_STATIONS = 100;
+const int MAX_COMMAND_LEN = 8192;
 
 struct Date {
     int month, day;
@@ -60,6 +61,31 @@ struct Time {
     }
 };
 
+// Growable text buffer that command handlers write their replies into,
+// so a reply can be produced on one thread and emitted on another
+class OutputBuffer {
+private:
+    char* buffer;
+    int length;
+    int capacity;
+
+    void reserve(int needed);
+
+    OutputBuffer(const OutputBuffer&);
+    OutputBuffer& operator=(const OutputBuffer&);
+
+public:
+    OutputBuffer() : buffer(nullptr), length(0), capacity(0) {}
+    ~OutputBuffer() { delete[] buffer; }
+
+    void append(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    void write(const char* data, int n);
+    void clear() { length = 0; }
+
+    const char* data() const { return buffer; }
+    int size() const { return length; }
+};
+
 inline int parseInt(const char* str) {
     return atoi(str);
 }
@@ -122,6 +148,32 @@ inline Time parseTime(const char* str) {
     return Time(hour, minute);
 }
 
+// Days before the first of each month in 2021 (index 1..12)
+const int DAYS_BEFORE_MONTH[13] = {0, 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+const int MINUTES_PER_DAY = 24 * 60;
+
+// Day of year (0-based) for a date in 2021
+inline int dateToDay(const Date& d) {
+    return DAYS_BEFORE_MONTH[d.month] + d.day - 1;
+}
+
+inline Date dayToDate(int day) {
+    int month = 12;
+    while (month > 1 && DAYS_BEFORE_MONTH[month] > day) month--;
+    return Date(month, day - DAYS_BEFORE_MONTH[month] + 1);
+}
+
+// Writes "mm-dd hr:mi" for an absolute minute count since the start of the year
+inline int formatDateTime(char* buf, int absMinutes) {
+    Date d = dayToDate(absMinutes / MINUTES_PER_DAY);
+    int minutes = absMinutes % MINUTES_PER_DAY;
+    return sprintf(buf, "%02d-%02d %02d:%02d", d.month, d.day, minutes / 60, minutes % 60);
+}
+
+// Sorts 64-bit keys ascending; tmp must hold n keys. Only bytes in
+// [lowByte, 8) take part, so callers can keep payload in the low bytes.
+void radixSortKeys(unsigned long long* keys, int n, unsigned long long* tmp, int lowByte);
+
 inline int dateDiff(const Date& d1, const Date& d2) {
     // Simple calculation assuming same year (2021)
     int days1 = d1.month * 30 + d1.day;